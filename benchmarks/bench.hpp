@@ -0,0 +1,38 @@
+#ifndef GUNGNIR_BENCH_HPP
+#define GUNGNIR_BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <vector>
+
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+inline double micros(Clock::duration d)
+{
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+// The p-th percentile (0 <= p <= 1) of `samples`, which get sorted.
+inline double percentile(std::vector<double> &samples, double p)
+{
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    const auto i = static_cast<std::size_t>(p * (samples.size() - 1));
+    return samples[i];
+}
+
+// Processor time used by the whole process, in seconds.
+inline double cpuSeconds()
+{
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+}
+
+}
+
+#endif  // GUNGNIR_BENCH_HPP
@@ -0,0 +1,68 @@
+// Throughput of dispatches with results from several threads at once, with
+// the pool's bookkeeping allocated from the heap and from per-thread free
+// lists.
+//
+// usage: bench_allocator [numThreads] [numTasks]
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "bench.hpp"
+
+namespace {
+
+struct RecyclingPolicy : gungnir::DefaultTaskPoolPolicy {
+    using Allocator = gungnir::RecyclingAllocator<char>;
+};
+
+template <typename Policy>
+void run(const char *name, std::size_t numThreads, int numTasks)
+{
+    gungnir::BasicTaskPool<Policy> tp{numThreads};
+    const int window = 256;
+
+    const auto start = bench::Clock::now();
+    std::vector<std::thread> producers;
+    for (std::size_t t = 0; t < numThreads; ++t) {
+        producers.emplace_back([&tp, numThreads, numTasks] {
+            std::vector<std::future<int>> futures;
+            futures.reserve(window);
+            const auto n = numTasks / static_cast<int>(numThreads);
+            for (int i = 0; i < n; i += window) {
+                for (int j = 0; j < window; ++j) {
+                    futures.emplace_back(tp.template dispatch<int>(
+                                [j] { return j; }));
+                }
+                for (auto &f: futures) {
+                    f.get();
+                }
+                futures.clear();
+            }
+        });
+    }
+    for (auto &p: producers) {
+        p.join();
+    }
+    const auto elapsed = bench::Clock::now() - start;
+
+    std::printf("%-10s %14.0f\n", name,
+            numTasks / (bench::micros(elapsed) / 1e6));
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const std::size_t numThreads = argc > 1 ? std::atoi(argv[1]) : 4;
+    const int numTasks = argc > 2 ? std::atoi(argv[2]) : 1000000;
+
+    std::printf("%-10s %14s\n", "allocator", "tasks/s");
+    run<gungnir::DefaultTaskPoolPolicy>("heap", numThreads, numTasks);
+    run<RecyclingPolicy>("recycling", numThreads, numTasks);
+}
@@ -0,0 +1,56 @@
+// Time to dispatch a large batch of tasks with results and collect them,
+// through a vector of futures and through a single bulk future.
+//
+// usage: bench_bulk [numThreads] [batchSize]
+
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "bench.hpp"
+
+int main(int argc, char *argv[])
+{
+    const std::size_t numThreads = argc > 1 ? std::atoi(argv[1]) : 4;
+    const int batchSize = argc > 2 ? std::atoi(argv[2]) : 100000;
+    const int numRounds = 10;
+
+    gungnir::TaskPool tp{numThreads};
+    std::vector<gungnir::Task<int>> tasks;
+    for (int i = 0; i < batchSize; ++i) {
+        tasks.emplace_back([i] { return i; });
+    }
+
+    std::printf("%-10s %14s\n", "results", "us/batch");
+
+    auto start = bench::Clock::now();
+    for (int r = 0; r < numRounds; ++r) {
+        auto futures = tp.dispatch<int>(tasks.cbegin(), tasks.cend());
+        long sum = 0;
+        for (auto &f: futures) {
+            sum += f.get();
+        }
+        if (sum < 0) {
+            std::abort();
+        }
+    }
+    std::printf("%-10s %14.0f\n", "futures",
+            bench::micros(bench::Clock::now() - start) / numRounds);
+
+    start = bench::Clock::now();
+    for (int r = 0; r < numRounds; ++r) {
+        auto results = tp.dispatchBulk<int>(tasks.cbegin(), tasks.cend());
+        long sum = 0;
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            sum += results[i];
+        }
+        if (sum < 0) {
+            std::abort();
+        }
+    }
+    std::printf("%-10s %14.0f\n", "bulk",
+            bench::micros(bench::Clock::now() - start) / numRounds);
+}
@@ -0,0 +1,72 @@
+// Throughput of several threads dispatching tiny tasks at once, through
+// TaskPool::dispatch (the queue's implicit per-thread sub-queues) and
+// through a Submitter each (explicit sub-queues).
+//
+// usage: bench_producers [numThreads] [numProducers] [numTasks]
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "bench.hpp"
+
+namespace {
+
+// Returns the number of tasks per second, from the first dispatch until
+// the last task has run.
+template <typename Dispatch>
+double run(std::size_t numThreads, int numProducers, int numTasks,
+        const Dispatch &dispatch)
+{
+    gungnir::TaskPool tp{numThreads};
+    std::atomic<int> done{0};
+    const gungnir::Task<void> task = [&done] {
+        done.fetch_add(1, std::memory_order_relaxed);
+    };
+
+    const auto start = bench::Clock::now();
+    std::vector<std::thread> producers;
+    for (int i = 0; i < numProducers; ++i) {
+        producers.emplace_back([&] { dispatch(tp, task, numTasks); });
+    }
+    for (auto &p: producers) {
+        p.join();
+    }
+    while (done.load() < numProducers * numTasks) {
+        std::this_thread::yield();
+    }
+    const auto elapsed = bench::Clock::now() - start;
+
+    return numProducers * numTasks / (bench::micros(elapsed) / 1e6);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const std::size_t numThreads = argc > 1 ? std::atoi(argv[1]) : 4;
+    const int numProducers = argc > 2 ? std::atoi(argv[2]) : 4;
+    const int numTasks = argc > 3 ? std::atoi(argv[3]) : 200000;
+
+    const auto implicit = run(numThreads, numProducers, numTasks,
+            [](gungnir::TaskPool &tp, const gungnir::Task<void> &task, int n) {
+                for (int i = 0; i < n; ++i) {
+                    tp.dispatch(task);
+                }
+            });
+    const auto submitter = run(numThreads, numProducers, numTasks,
+            [](gungnir::TaskPool &tp, const gungnir::Task<void> &task, int n) {
+                auto s = tp.submitter();
+                for (int i = 0; i < n; ++i) {
+                    s.dispatch(task);
+                }
+            });
+
+    std::printf("%-10s %14s\n", "producer", "tasks/s");
+    std::printf("%-10s %14.0f\n", "dispatch", implicit);
+    std::printf("%-10s %14.0f\n", "submitter", submitter);
+}
@@ -0,0 +1,47 @@
+// Throughput of tasks that do next to nothing, with workers taking tasks
+// off the queue one at a time and in batches of various sizes.
+//
+// usage: bench_tiny_tasks [numThreads] [numTasks]
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "bench.hpp"
+
+int main(int argc, char *argv[])
+{
+    const std::size_t numThreads = argc > 1 ? std::atoi(argv[1]) : 4;
+    const int numTasks = argc > 2 ? std::atoi(argv[2]) : 1000000;
+    const int chunkSize = 1000;
+
+    std::printf("%-10s %14s\n", "batch", "tasks/s");
+
+    for (const std::size_t maxBatchSize: {1, 4, 32, 256}) {
+        gungnir::TaskPoolOptions options;
+        options.minThreads = options.maxThreads = numThreads;
+        options.maxBatchSize = maxBatchSize;
+        gungnir::TaskPool tp{options};
+
+        std::atomic<int> done{0};
+        const std::vector<gungnir::Task<void>> tasks(chunkSize, [&done] {
+            done.fetch_add(1, std::memory_order_relaxed);
+        });
+
+        const auto start = bench::Clock::now();
+        for (int i = 0; i < numTasks; i += chunkSize) {
+            tp.dispatch(tasks.cbegin(), tasks.cend());
+        }
+        while (done.load() < numTasks / chunkSize * chunkSize) {
+            std::this_thread::yield();
+        }
+        const auto elapsed = bench::Clock::now() - start;
+
+        std::printf("%-10zu %14.0f\n", maxBatchSize,
+                done.load() / (bench::micros(elapsed) / 1e6));
+    }
+}
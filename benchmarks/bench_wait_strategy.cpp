@@ -0,0 +1,73 @@
+// Submit-to-start latency of a task dispatched to an idle task pool, for
+// each wait strategy, along with the CPU time burnt while idle.
+//
+// usage: bench_wait_strategy [numThreads] [numSamples] [gapMicros]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "bench.hpp"
+
+int main(int argc, char *argv[])
+{
+    const std::size_t numThreads = argc > 1 ? std::atoi(argv[1]) : 2;
+    const int numSamples = argc > 2 ? std::atoi(argv[2]) : 2000;
+    const std::chrono::microseconds gap{argc > 3 ? std::atoi(argv[3]) : 200};
+
+    const std::pair<gungnir::WaitStrategy, const char *> strategies[] = {
+        {gungnir::WaitStrategy::Block, "Block"},
+        {gungnir::WaitStrategy::SpinThenPark, "SpinThenPark"},
+        {gungnir::WaitStrategy::Yield, "Yield"},
+        {gungnir::WaitStrategy::BusyPoll, "BusyPoll"},
+        {gungnir::WaitStrategy::Adaptive, "Adaptive"},
+    };
+
+    std::printf("%-14s %10s %10s %10s %10s\n",
+            "strategy", "p50 (us)", "p99 (us)", "p99.9 (us)", "cpu (s)");
+
+    for (const auto &strategy: strategies) {
+        gungnir::TaskPoolOptions options;
+        options.minThreads = options.maxThreads = numThreads;
+        options.waitStrategy = strategy.first;
+
+        std::vector<double> latencies;
+        latencies.reserve(numSamples);
+        double cpu;
+        {
+            gungnir::TaskPool tp{options};
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+
+            const auto cpuBefore = bench::cpuSeconds();
+            for (int i = 0; i < numSamples; ++i) {
+                std::atomic<bool> started{false};
+                bench::Clock::time_point start;
+
+                const auto submit = bench::Clock::now();
+                tp.dispatch([&start, &started] {
+                    start = bench::Clock::now();
+                    started.store(true, std::memory_order_release);
+                });
+                while (!started.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                latencies.emplace_back(bench::micros(start - submit));
+
+                std::this_thread::sleep_for(gap);
+            }
+            cpu = bench::cpuSeconds() - cpuBefore;
+        }
+
+        const auto p50 = bench::percentile(latencies, 0.5);
+        const auto p99 = bench::percentile(latencies, 0.99);
+        const auto p999 = bench::percentile(latencies, 0.999);
+        std::printf("%-14s %10.2f %10.2f %10.2f %10.3f\n",
+                strategy.second, p50, p99, p999, cpu);
+    }
+}
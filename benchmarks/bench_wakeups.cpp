@@ -0,0 +1,136 @@
+// How often workers sleep and get woken per task, for bursts of tasks
+// dispatched one by one or in bulk to a pool that went idle in between:
+// context switches from getrusage, and for the task pool its own counts of
+// sleeps and wake-ups. These stand in for the futex calls, which are not
+// counted themselves. The baseline is a pool of workers blocking on a
+// moodycamel::BlockingConcurrentQueue, whose semaphore is signaled once per
+// task whether or not any worker sleeps.
+//
+// usage: bench_wakeups [numThreads] [numBursts] [burstSize]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "gungnir/gungnir.hpp"
+#include "gungnir/external/blockingconcurrentqueue.h"
+
+#include "bench.hpp"
+
+namespace {
+
+class BlockingPool final {
+public:
+    explicit BlockingPool(std::size_t numThreads)
+    {
+        for (std::size_t i = 0; i < numThreads; ++i) {
+            threads_.emplace_back([this] {
+                gungnir::Task<void> t;
+                for (;;) {
+                    queue_.wait_dequeue(t);
+                    if (!t) {
+                        return;
+                    }
+                    t();
+                }
+            });
+        }
+    }
+
+    ~BlockingPool()
+    {
+        for (std::size_t i = 0; i < threads_.size(); ++i) {
+            queue_.enqueue(nullptr);
+        }
+        for (auto &t: threads_) {
+            t.join();
+        }
+    }
+
+    void dispatch(const gungnir::Task<void> &task)
+    {
+        queue_.enqueue(task);
+    }
+
+    template <typename Iter>
+    void dispatch(Iter first, Iter last)
+    {
+        queue_.enqueue_bulk(first, last - first);
+    }
+
+private:
+    moodycamel::BlockingConcurrentQueue<gungnir::Task<void>> queue_;
+    std::vector<std::thread> threads_;
+};
+
+long contextSwitches()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+// Runs the bursts and returns the context switches per task.
+template <typename Pool>
+double run(Pool &pool, int numBursts, int burstSize, bool bulk)
+{
+    std::atomic<int> done{0};
+    const std::vector<gungnir::Task<void>> tasks(burstSize, [&done] {
+        done.fetch_add(1, std::memory_order_relaxed);
+    });
+
+    const auto before = contextSwitches();
+    for (int i = 1; i <= numBursts; ++i) {
+        if (bulk) {
+            pool.dispatch(tasks.cbegin(), tasks.cend());
+        } else {
+            for (const auto &t: tasks) {
+                pool.dispatch(t);
+            }
+        }
+        while (done.load() < i * burstSize) {
+            std::this_thread::yield();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    return static_cast<double>(contextSwitches() - before) /
+        (numBursts * burstSize);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const std::size_t numThreads = argc > 1 ? std::atoi(argv[1]) : 4;
+    const int numBursts = argc > 2 ? std::atoi(argv[2]) : 200;
+    const int burstSize = argc > 3 ? std::atoi(argv[3]) : 1000;
+    const double numTasks = static_cast<double>(numBursts) * burstSize;
+
+    std::printf("%-10s %-6s %12s %12s %12s\n",
+            "pool", "mode", "csw/task", "sleeps/task", "wakes/task");
+
+    for (const bool bulk: {false, true}) {
+        const char *mode = bulk ? "bulk" : "single";
+        {
+            BlockingPool pool{numThreads};
+            const auto csw = run(pool, numBursts, burstSize, bulk);
+            std::printf("%-10s %-6s %12.4f %12s %12s\n",
+                    "baseline", mode, csw, "-", "-");
+        }
+        {
+            gungnir::TaskPoolOptions options;
+            options.minThreads = options.maxThreads = numThreads;
+            gungnir::TaskPool pool{options};
+            const auto csw = run(pool, numBursts, burstSize, bulk);
+            const auto stats = pool.stats();
+            std::printf("%-10s %-6s %12.4f %12.4f %12.4f\n",
+                    "gungnir", mode, csw,
+                    stats.numSleeps / numTasks, stats.numWakes / numTasks);
+        }
+    }
+}
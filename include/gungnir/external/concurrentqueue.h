@@ -27,6 +27,10 @@
 // TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
 // EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+// Local modifications for gungnir, each between BEGIN and END GUNGNIR LOCAL
+// MODIFICATION markers, to be carried over when upgrading this file:
+// - ConcurrentQueue::trim_free_blocks(), used by BasicTaskPool::trimMemory().
+
 
 #pragma once
 
@@ -1238,6 +1242,32 @@ public:
 	}
 	
 	
+	// BEGIN GUNGNIR LOCAL MODIFICATION (see the note at the top of this file)
+	// Frees the dynamically allocated blocks on the global free list (blocks emptied
+	// by implicit producers), and returns how many it freed. Blocks from the initial
+	// pool and those held by producers are kept.
+	// Not thread-safe with respect to enqueue operations, which may take blocks off
+	// the free list; dequeue operations may proceed concurrently.
+	size_t trim_free_blocks()
+	{
+		size_t count = 0;
+		Block* kept = nullptr;
+		for (auto block = freeList.try_get(); block != nullptr; block = freeList.try_get()) {
+			if (block->dynamicallyAllocated) {
+				destroy(block);
+				++count;
+			}
+			else {
+				block->next = kept;
+				kept = block;
+			}
+		}
+		add_blocks_to_free_list(kept);
+		return count;
+	}
+	// END GUNGNIR LOCAL MODIFICATION
+	
+	
 	// Returns true if the underlying atomic variables used by
 	// the queue are lock-free (they should be on most platforms).
 	// Thread-safe.
@@ -17,266 +17,5392 @@
 #define GUNGNIR_HPP
 
 #include <algorithm>
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
 #include <functional>
+#include <iterator>
+#include <limits>
 #include <future>
+#include <list>
 #include <memory>
 #include <mutex>
+#include <new>
+#include <set>
+#include <sstream>
 #include <stdexcept>
+#include <string>
 #include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
-#include "gungnir/external/blockingconcurrentqueue.h"
+#ifdef __linux__
+#include <cerrno>
+#include <ctime>
+
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "gungnir/external/concurrentqueue.h"
 
 namespace gungnir {
 
 template <typename R>
 using Task = std::function<R()>;
 
-class TaskPool final {
+enum class ConcurrencySource {
+    Override,             // the GUNGNIR_CONCURRENCY environment variable
+    CgroupQuota,          // the CPU bandwidth quota of the process's cgroup
+    AffinityMask,         // the set of CPUs the process may run on
+    HardwareConcurrency,  // std::thread::hardware_concurrency()
+    Fallback              // nothing could be detected
+};
+
+struct ConcurrencyInfo {
+    std::size_t concurrency;
+    ConcurrencySource source;
+    std::string reason;
+};
+
+namespace detail {
+
+// Parses a positive count made of decimal digits only; `strtoul` by itself
+// would take "-1", " 3" or "3x" as well, and wrap around on overflow.
+inline bool parseCount(const char *text, std::size_t &n)
+{
+    if (*text < '0' || *text > '9') {
+        return false;
+    }
+    char *end = nullptr;
+    errno = 0;
+    const auto value = std::strtoul(text, &end, 10);
+    if (errno == ERANGE || *end != '\0' || value == 0) {
+        return false;
+    }
+    n = value;
+    return true;
+}
+
+#ifdef __linux__
+inline std::size_t cpusOfQuota(double quota, double period)
+{
+    return std::max<std::size_t>(1,
+            static_cast<std::size_t>((quota + period - 1) / period));
+}
+
+// The CPU quota of the cgroup at `path` in the hierarchy mounted at `root`,
+// or 0 if it has none.
+inline std::size_t cgroupQuota(
+        bool v2, const std::string &root, const std::string &path)
+{
+    if (v2) {
+        std::ifstream in{root + path + "/cpu.max"};
+        std::string quota;
+        double period;
+        if (in >> quota >> period && quota != "max" && period > 0) {
+            return cpusOfQuota(std::atof(quota.c_str()), period);
+        }
+    } else {
+        std::ifstream inQuota{root + path + "/cpu.cfs_quota_us"};
+        std::ifstream inPeriod{root + path + "/cpu.cfs_period_us"};
+        double quota, period;
+        if (inQuota >> quota && inPeriod >> period && quota > 0 && period > 0) {
+            return cpusOfQuota(quota, period);
+        }
+    }
+    return 0;
+}
+
+// The tightest CPU quota among the process's cgroup and its ancestors, for
+// both cgroup v1 and v2, or 0 if there is none.
+inline std::size_t cgroupQuota(std::string &reason)
+{
+    std::ifstream in{"/proc/self/cgroup"};
+    std::size_t result = 0;
+
+    // lines look like "0::/path" (v2) or "4:cpu,cpuacct:/path" (v1)
+    for (std::string line; std::getline(in, line); ) {
+        const auto first = line.find(':');
+        const auto second = line.find(':', first + 1);
+        if (first == std::string::npos || second == std::string::npos) {
+            continue;
+        }
+        const auto controllers = "," +
+            line.substr(first + 1, second - first - 1) + ",";
+        const bool v2 = controllers == ",,";
+        if (!v2 && controllers.find(",cpu,") == std::string::npos) {
+            continue;
+        }
+
+        const std::string root = v2
+            ? "/sys/fs/cgroup"
+            : "/sys/fs/cgroup/" + controllers.substr(1,
+                    controllers.size() - 2);
+        for (auto path = line.substr(second + 1); ; ) {
+            const auto cpus = cgroupQuota(v2, root, path == "/" ? "" : path);
+            if (cpus > 0 && (result == 0 || cpus < result)) {
+                result = cpus;
+                reason = std::string{v2 ? "cgroup v2" : "cgroup v1"} +
+                    " CPU quota of " + root + path;
+            }
+            if (path.empty() || path == "/") {
+                break;
+            }
+            path.erase(path.rfind('/'));
+        }
+    }
+    return result;
+}
+#endif
+
+}
+
+// Determines how many threads the process can usefully run in parallel:
+// the smallest of the cgroup CPU quota, the affinity mask and the hardware
+// concurrency, unless overridden by the GUNGNIR_CONCURRENCY environment
+// variable. An override that is not a positive decimal number is ignored,
+// and said so in the reason. Never returns 0.
+inline ConcurrencyInfo detectConcurrency()
+{
+    std::string ignored;
+    if (const char *env = std::getenv("GUNGNIR_CONCURRENCY")) {
+        std::size_t n = 0;
+        if (detail::parseCount(env, n)) {
+            return {n, ConcurrencySource::Override,
+                std::string{"GUNGNIR_CONCURRENCY="} + env};
+        }
+        ignored = std::string{" (ignored GUNGNIR_CONCURRENCY="} + env + ")";
+    }
+
+    ConcurrencyInfo info{std::thread::hardware_concurrency(),
+        ConcurrencySource::HardwareConcurrency,
+        "std::thread::hardware_concurrency()"};
+    if (info.concurrency == 0) {
+        info = {1, ConcurrencySource::Fallback,
+            "no hardware concurrency reported"};
+    }
+
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+        const auto n = static_cast<std::size_t>(CPU_COUNT(&cpus));
+        if (n > 0 && n < info.concurrency) {
+            info = {n, ConcurrencySource::AffinityMask,
+                "sched_getaffinity() CPU mask"};
+        }
+    }
+
+    std::string reason;
+    const auto n = detail::cgroupQuota(reason);
+    if (n > 0 && n < info.concurrency) {
+        info = {n, ConcurrencySource::CgroupQuota, reason};
+    }
+#endif
+
+    info.reason += ignored;
+    return info;
+}
+
+// `detectConcurrency()`, evaluated once per process. Task pools use it as
+// their default size.
+inline const ConcurrencyInfo & defaultConcurrency()
+{
+    static const ConcurrencyInfo info = detectConcurrency();
+    return info;
+}
+
+struct NumaNode {
+    std::size_t id;             // as in /sys/devices/system/node/node<id>
+    std::vector<int> cpus;      // limited to the process's affinity mask
+    std::vector<int> distances; // to each node, indexed by node id
+};
+
+namespace detail {
+
+// Parses a kernel CPU or node list, like "0-3,8-11".
+inline std::vector<int> parseIdList(const std::string &list)
+{
+    std::vector<int> ids;
+    std::istringstream in{list};
+    for (std::string range; std::getline(in, range, ','); ) {
+        int first, last;
+        char dash;
+        std::istringstream r{range};
+        if (!(r >> first)) {
+            continue;
+        }
+        if (r >> dash >> last && dash == '-') {
+            for (int i = first; i <= last; ++i) {
+                ids.emplace_back(i);
+            }
+        } else {
+            ids.emplace_back(first);
+        }
+    }
+    return ids;
+}
+
+inline std::string readLine(const std::string &path)
+{
+    std::ifstream in{path};
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+// The CPUs the calling process may run on.
+inline std::vector<int> allowedCpus()
+{
+    std::vector<int> result;
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &cpus)) {
+                result.emplace_back(cpu);
+            }
+        }
+    }
+#endif
+    if (result.empty()) {
+        const int n = std::max(1u, std::thread::hardware_concurrency());
+        for (int cpu = 0; cpu < n; ++cpu) {
+            result.emplace_back(cpu);
+        }
+    }
+    return result;
+}
+
+// Restricts the calling thread to `cpus`; a no-op where unsupported.
+inline void setAffinity(const std::vector<int> &cpus)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu: cpus) {
+        CPU_SET(cpu, &set);
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+#else
+    static_cast<void>(cpus);
+#endif
+}
+
+inline int currentCpu()
+{
+#ifdef __linux__
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+}
+
+// The NUMA nodes the process can run on, as reported by
+// /sys/devices/system/node. Where that is unavailable, all allowed CPUs are
+// reported as a single node.
+inline std::vector<NumaNode> numaTopology()
+{
+    const std::string sys = "/sys/devices/system/node/";
+    const auto allowed = detail::allowedCpus();
+    const std::set<int> allowedSet(allowed.cbegin(), allowed.cend());
+
+    std::vector<NumaNode> nodes;
+    for (auto id: detail::parseIdList(detail::readLine(sys + "online"))) {
+        const auto dir = sys + "node" + std::to_string(id) + "/";
+
+        NumaNode node{static_cast<std::size_t>(id), {}, {}};
+        for (auto cpu: detail::parseIdList(detail::readLine(dir + "cpulist"))) {
+            if (allowedSet.count(cpu)) {
+                node.cpus.emplace_back(cpu);
+            }
+        }
+        std::istringstream in{detail::readLine(dir + "distance")};
+        for (int d; in >> d; ) {
+            node.distances.emplace_back(d);
+        }
+
+        if (!node.cpus.empty()) {
+            nodes.emplace_back(std::move(node));
+        }
+    }
+
+    if (nodes.empty()) {
+        nodes.push_back({0, allowed, {}});
+    }
+    return nodes;
+}
+
+// Where a task pool's workers may run.
+enum class Placement {
+    None,      // wherever the OS schedules them, sharing a single queue
+    Compact,   // one CPU each, filling up one NUMA node after another
+    Scatter,   // one CPU each, spread round-robin across NUMA nodes
+    Explicit,  // one CPU each, taken round-robin from `TaskPoolOptions::cpus`
+    PerNode    // any CPU of their node, with workers spread across nodes
+};
+
+// How idle workers wait for tasks.
+enum class WaitStrategy {
+    Block,         // go to sleep right away
+    SpinThenPark,  // spin for `spinCount` iterations, then go to sleep
+    Yield,         // yield the CPU in a loop, never sleeping
+    BusyPoll,      // spin in a loop, never sleeping; pair with pinning
+    Adaptive       // like SpinThenPark, tuning the spin count as it goes
+};
+
+enum class GrowthPolicy {
+    QueueDepth,  // grow when more than `growthQueueDepth` tasks are queued
+    WaitTime     // grow when no task was dequeued for `growthWaitTime`
+};
+
+// What a dispatch to a task pool whose queue is full does.
+enum class RejectionPolicy {
+    Block,          // wait until there is room
+    CallerRuns,     // run the task on the dispatching thread instead
+    DiscardOldest,  // drop the oldest queued task to make room
+    Throw           // throw std::overflow_error
+};
+
+// Low-priority dispatches are the first to go when a task pool is
+// overloaded.
+enum class Priority {
+    Normal,
+    Low
+};
+
+// The order in which `mapBounded` passes results to its sink.
+enum class MapOrder {
+    Completion,  // as soon as each result is ready
+    Input        // in the order of the inputs, held back as needed
+};
+
+// Sizing of a task pool. Workers are added on demand, up to `maxThreads`,
+// while every worker is busy and the growth policy triggers; workers beyond
+// `minThreads` retire after being idle for `idleTimeout`.
+struct TaskPoolOptions {
+    std::size_t minThreads = 0;
+    std::size_t maxThreads = defaultConcurrency().concurrency;
+    std::chrono::milliseconds idleTimeout{10000};
+    GrowthPolicy growthPolicy = GrowthPolicy::QueueDepth;
+    std::size_t growthQueueDepth = 0;
+    std::chrono::microseconds growthWaitTime{1000};
+
+    // With any placement but `Placement::None`, the pool keeps one queue per
+    // NUMA node; workers take tasks from their own node's queue first, and
+    // only then from other nodes, nearest first.
+    Placement placement = Placement::None;
+    std::vector<int> cpus;  // for `Placement::Explicit`, from the affinity mask
+
+    WaitStrategy waitStrategy = WaitStrategy::SpinThenPark;
+    std::size_t spinCount = 10000;
+
+    // Workers take up to this many tasks off the queue at once, adapting
+    // the batch size to how many tasks are queued, but never more than
+    // their share while other workers are idle. 1 turns batching off.
+    std::size_t maxBatchSize = 32;
+
+    // Cold-start tuning: how many tasks each node's queue has room for
+    // before it allocates (0 leaves it to the queue), how many bytes of
+    // its stack each worker touches when it starts (well below the stack
+    // size), and whether the constructor runs a few rounds of no-op tasks
+    // through the initial workers.
+    std::size_t initialQueueCapacity = 0;
+    std::size_t stackPrefault = 0;
+    bool warmup = false;
+
+    // Once a worker has been idle for this long, it gives the queue blocks
+    // left over from a burst back to the allocator, as `trimMemory` does.
+    // 0 never trims automatically.
+    std::chrono::milliseconds trimIdleAfter{0};
+
+    // The maximum number of queued tasks (not counting running ones), or 0
+    // for an unbounded queue, and what `dispatch` does once it is full.
+    std::size_t capacity = 0;
+    RejectionPolicy rejectionPolicy = RejectionPolicy::Block;
+
+    // The pool is saturated once no worker is idle, it cannot grow, and
+    // more than this many tasks are queued; see `TaskPool::dispatchOrRun`.
+    std::size_t saturationQueueDepth = 0;
+
+    // Load shedding after CoDel: once every task picked up during a whole
+    // `sheddingInterval` has waited longer than `sheddingTarget` in the
+    // queue, the pool is overloaded and sheds low-priority dispatches, until
+    // a task waits less than that or the queue runs empty. A zero target
+    // turns shedding off. `onOverload` is called, on a worker, whenever the
+    // pool becomes overloaded or recovers, with the latest sojourn time.
+    std::chrono::microseconds sheddingTarget{0};
+    std::chrono::milliseconds sheddingInterval{100};
+    std::function<void(bool overloaded, std::chrono::microseconds sojourn)>
+        onOverload;
+};
+
+// A snapshot of what a task pool is doing, see `TaskPool::stats`.
+struct TaskPoolStats {
+    std::size_t numThreads = 0;
+    std::size_t numIdle = 0;    // workers looking for work
+    std::size_t numQueued = 0;  // approximate
+    std::size_t numSleeps = 0;  // times a worker went to sleep
+    std::size_t numWakes = 0;   // wake-up system calls made for sleepers
+
+    // Tasks that did not fit into a full queue.
+    std::size_t numRejected = 0;    // refused, or thrown back at the caller
+    std::size_t numDiscarded = 0;   // dropped by RejectionPolicy::DiscardOldest
+    std::size_t numCallerRuns = 0;  // run by the dispatching thread
+
+    // Also counted in `numCallerRuns`: tasks run by the dispatching thread
+    // because `dispatchOrRun` found the pool saturated.
+    std::size_t numSaturatedRuns = 0;
+
+    bool overloaded = false;
+    std::size_t numShed = 0;  // low-priority dispatches shed while overloaded
+
+    // Memory held by the queue, and the part of it queued tasks take up.
+    std::size_t queueBytesRetained = 0;
+    std::size_t queueBytesInUse = 0;  // approximate
+};
+
+enum class ShutdownMode {
+    Drain,  // run every queued task before stopping the workers
+    Now     // stop the workers as soon as their current tasks finish
+};
+
+// What `invokeAll` returns for a callable that returns void.
+struct NoResult {
+};
+
+namespace detail {
+
+// Index of the calling thread into any per-thread sharded structure.
+inline std::size_t threadShard()
+{
+    static thread_local const std::size_t shard =
+        std::hash<std::thread::id>{}(std::this_thread::get_id());
+    return shard;
+}
+
+// An atomic counter on a cache line of its own.
+struct PaddedCounter {
+    std::atomic<std::ptrdiff_t> value{0};
+    char padding[64 - sizeof(std::atomic<std::ptrdiff_t>)];
+};
+
+// A counter split across cache lines so that threads hashing to different
+// shards never contend. Only the (non-atomic) sum is ever inspected.
+class ShardedCounter final {
+public:
+    static constexpr std::size_t numShards = 16;
+
+    void add(std::size_t shard, std::ptrdiff_t n)
+    {
+        shards_[shard % numShards].value.fetch_add(n);
+    }
+
+    bool isZero() const
+    {
+        for (const auto &s: shards_) {
+            if (s.value.load() != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::array<PaddedCounter, numShards> shards_;
+};
+
+// A fixed number of slots split across cache lines. Threads take slots from
+// the shard they hash to, and only look at the other shards once theirs is
+// empty; they give slots back to their own shard.
+class ShardedSlots final {
+public:
+    static constexpr std::size_t numShards = 16;
+
+    explicit ShardedSlots(std::size_t n)
+    {
+        for (std::size_t i = 0; i < numShards; ++i) {
+            shards_[i].value = static_cast<std::ptrdiff_t>(
+                    n / numShards + (i < n % numShards ? 1 : 0));
+        }
+    }
+
+    // Takes up to `n` slots and returns how many it got.
+    std::size_t acquire(std::size_t shard, std::size_t n)
+    {
+        std::size_t acquired = 0;
+        for (std::size_t i = 0; i < numShards && acquired < n; ++i) {
+            auto &value = shards_[(shard + i) % numShards].value;
+            auto free = value.load(std::memory_order_relaxed);
+            while (free > 0) {
+                const auto k = std::min(static_cast<std::size_t>(free),
+                        n - acquired);
+                if (value.compare_exchange_weak(free,
+                            free - static_cast<std::ptrdiff_t>(k),
+                            std::memory_order_acquire,
+                            std::memory_order_relaxed)) {
+                    acquired += k;
+                    break;
+                }
+            }
+        }
+        return acquired;
+    }
+
+    // Takes `n` slots whether or not there are any left.
+    void overdraw(std::size_t shard, std::size_t n)
+    {
+        shards_[shard % numShards].value.fetch_sub(
+                static_cast<std::ptrdiff_t>(n), std::memory_order_relaxed);
+    }
+
+    void release(std::size_t shard, std::size_t n)
+    {
+        shards_[shard % numShards].value.fetch_add(
+                static_cast<std::ptrdiff_t>(n), std::memory_order_release);
+    }
+
+private:
+    std::array<PaddedCounter, numShards> shards_;
+};
+
+// Lets idle threads sleep until there may be new work, at no cost to the
+// threads producing work as long as nobody waits: notifying then is one
+// fence and one load. Waiters announce themselves with `prepareWait`, look
+// for work once more, and then either `cancelWait` or `commitWait`. Only
+// waiters that actually went to sleep cost a system call to wake up, and
+// only once: sleepers that were woken up but have not run yet are not
+// woken up again.
+class EventCount final {
+public:
+    using Key = std::uint32_t;
+
+    Key prepareWait()
+    {
+        waiters_.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return epoch_.load(std::memory_order_acquire);
+    }
+
+    void cancelWait()
+    {
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Whether anyone notified since `prepareWait` returned `key`.
+    bool notified(Key key) const
+    {
+        return epoch_.load(std::memory_order_acquire) != key;
+    }
+
+    // Sleeps until notified or until `deadline`, and ends the wait. Returns
+    // false on timeout; may return true spuriously.
+    bool commitWait(Key key, std::chrono::steady_clock::time_point deadline)
+    {
+        bool woken = true;
+        if (!notified(key)) {
+            sleepers_.fetch_add(sleeper);
+            woken = sleep(key, deadline);
+
+            // Use up a wake-up, whether or not it was meant for us; the
+            // count of signaled sleepers may be low, but never too high.
+            auto s = sleepers_.load(std::memory_order_relaxed);
+            while (!sleepers_.compare_exchange_weak(s,
+                        s - sleeper - ((s & signaledMask) > 0 ? 1 : 0),
+                        std::memory_order_relaxed)) {
+            }
+        }
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+        return woken;
+    }
+
+    // Wakes up at most `n` sleepers.
+    void notify(std::size_t n = 1)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        epoch_.fetch_add(1);
+
+        auto s = sleepers_.load();
+        std::uint64_t k;
+        do {
+            const auto unsignaled = (s >> 32) - (s & signaledMask);
+            if (unsignaled == 0) {
+                return;
+            }
+            k = std::min<std::uint64_t>(n, unsignaled);
+        } while (!sleepers_.compare_exchange_weak(s, s + k));
+
+        // Hand back the wake-ups that found nobody asleep yet, lest later
+        // sleepers be taken for signaled ones.
+        auto unused = k - wake(k);
+        s = sleepers_.load(std::memory_order_relaxed);
+        while (unused > 0 && !sleepers_.compare_exchange_weak(s,
+                    s - std::min(unused, s & signaledMask),
+                    std::memory_order_relaxed)) {
+        }
+    }
+
+    void notifyAll()
+    {
+        notify(std::numeric_limits<std::size_t>::max());
+    }
+
+    // The number of times a thread went to sleep, and the number of times
+    // sleeping threads had to be woken up (each a system call).
+    std::size_t numSleeps() const
+    {
+        return numSleeps_.load(std::memory_order_relaxed);
+    }
+
+    std::size_t numWakes() const
+    {
+        return numWakes_.load(std::memory_order_relaxed);
+    }
+
+private:
+#ifdef __linux__
+    bool sleep(Key key, std::chrono::steady_clock::time_point deadline)
+    {
+        numSleeps_.fetch_add(1, std::memory_order_relaxed);
+
+        const auto addr = reinterpret_cast<Key *>(&epoch_);
+        if (deadline == std::chrono::steady_clock::time_point::max()) {
+            syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, key,
+                    nullptr, nullptr, 0);
+            return true;
+        }
+
+        const auto timeout = deadline - std::chrono::steady_clock::now();
+        if (timeout <= std::chrono::steady_clock::duration::zero()) {
+            return notified(key);
+        }
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                timeout).count();
+        timespec ts;
+        ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+        ts.tv_nsec = static_cast<long>(ns % 1000000000);
+        if (syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, key,
+                    &ts, nullptr, 0) == -1 && errno == ETIMEDOUT) {
+            return notified(key);
+        }
+        return true;
+    }
+
+    // Returns the number of sleepers woken up.
+    std::uint64_t wake(std::uint64_t n)
+    {
+        numWakes_.fetch_add(1, std::memory_order_relaxed);
+        const auto woken = syscall(SYS_futex,
+                reinterpret_cast<Key *>(&epoch_), FUTEX_WAKE_PRIVATE,
+                static_cast<int>(std::min<std::uint64_t>(n,
+                        std::numeric_limits<int>::max())),
+                nullptr, nullptr, 0);
+        return woken > 0 ? static_cast<std::uint64_t>(woken) : 0;
+    }
+#else
+    bool sleep(Key key, std::chrono::steady_clock::time_point deadline)
+    {
+        numSleeps_.fetch_add(1, std::memory_order_relaxed);
+
+        std::unique_lock<std::mutex> lk{m_};
+        const auto woken = [this, key] { return notified(key); };
+        if (deadline == std::chrono::steady_clock::time_point::max()) {
+            cv_.wait(lk, woken);
+            return true;
+        }
+        return cv_.wait_until(lk, deadline, woken);
+    }
+
+    // Condition variables do not tell how many threads they woke up, so
+    // this claims none, at the cost of waking up sleepers more often.
+    std::uint64_t wake(std::uint64_t n)
+    {
+        numWakes_.fetch_add(1, std::memory_order_relaxed);
+
+        // Sleepers check the epoch under the lock, so taking it here
+        // ensures none of them misses the increment.
+        std::unique_lock<std::mutex> lk{m_};
+        if (n == 1) {
+            cv_.notify_one();
+        } else {
+            cv_.notify_all();
+        }
+        return 0;
+    }
+
+    std::mutex m_;
+    std::condition_variable cv_;
+#endif
+
+    static_assert(sizeof(std::atomic<Key>) == sizeof(Key),
+            "futexes need plain 32-bit words");
+
+    // Sleepers in the upper half, those of them signaled in the lower.
+    static constexpr std::uint64_t sleeper = std::uint64_t{1} << 32;
+    static constexpr std::uint64_t signaledMask = sleeper - 1;
+
+    std::atomic<Key> epoch_{0};
+    std::atomic<std::size_t> waiters_{0};
+    std::atomic<std::uint64_t> sleepers_{0};
+    std::atomic<std::size_t> numSleeps_{0};
+    std::atomic<std::size_t> numWakes_{0};
+};
+
+// Touches `bytes` of the calling thread's stack, a page at a time, so that
+// it is mapped (on the thread's NUMA node) before anything needs it.
+inline void prefaultStack(std::size_t bytes)
+{
+    volatile char page[4096];
+    page[0] = 0;
+    if (bytes > sizeof(page)) {
+        prefaultStack(bytes - sizeof(page));
+    }
+    page[sizeof(page) - 1] = 0;
+}
+
+// Where the queue memory allocated on the calling thread is counted, if
+// anywhere.
+inline std::atomic<std::size_t> *& allocationCounter()
+{
+    static thread_local std::atomic<std::size_t> *counter = nullptr;
+    return counter;
+}
+
+// Counts the queue memory allocated on the calling thread in `counter`
+// while in scope.
+class CountedAllocations final {
 public:
-    explicit TaskPool(
-            std::size_t numThreads = std::thread::hardware_concurrency())
-        : numThreads_{numThreads}
+    explicit CountedAllocations(std::atomic<std::size_t> &counter)
+        : previous_{allocationCounter()}
+    {
+        allocationCounter() = &counter;
+    }
+
+    ~CountedAllocations()
+    {
+        allocationCounter() = previous_;
+    }
+
+    CountedAllocations(const CountedAllocations &other) = delete;
+    CountedAllocations & operator=(const CountedAllocations &other) = delete;
+
+private:
+    std::atomic<std::size_t> *const previous_;
+};
+
+// moodycamel's default queue traits, but the queue memory comes from a
+// default-constructed `Alloc`, and each allocation is counted where
+// `CountedAllocations` says, and taken off that count again when freed.
+template <typename Alloc>
+struct CountingQueueTraits : moodycamel::ConcurrentQueueDefaultTraits {
+    static void * malloc(std::size_t size)
+    {
+        const auto numUnits = (headerSize + size + unitSize - 1) / unitSize;
+        Units units;
+        char *p = nullptr;
+        try {
+            p = reinterpret_cast<char *>(
+                    UnitTraits::allocate(units, numUnits));
+        } catch (const std::bad_alloc &) {
+            return nullptr;
+        }
+        const auto counter = allocationCounter();
+        if (counter) {
+            counter->fetch_add(size, std::memory_order_relaxed);
+        }
+        new (p) Header{size, numUnits, counter};
+        return p + headerSize;
+    }
+
+    static void free(void *ptr)
     {
-        threads_.reserve(numThreads_);
+        if (ptr == nullptr) {
+            return;
+        }
+        const auto p = static_cast<char *>(ptr) - headerSize;
+        const auto header = reinterpret_cast<const Header *>(p);
+        if (header->counter) {
+            header->counter->fetch_sub(header->size,
+                    std::memory_order_relaxed);
+        }
+        Units units;
+        UnitTraits::deallocate(units, reinterpret_cast<Unit *>(p),
+                header->numUnits);
+    }
+
+private:
+    struct Header {
+        std::size_t size;
+        std::size_t numUnits;
+        std::atomic<std::size_t> *counter;
+    };
+
+    using Unit = typename std::aligned_storage<alignof(std::max_align_t),
+          alignof(std::max_align_t)>::type;
+    using UnitTraits = typename std::allocator_traits<Alloc>::template
+        rebind_traits<Unit>;
+    using Units = typename UnitTraits::allocator_type;
+
+    static constexpr std::size_t unitSize = sizeof(Unit);
+    static constexpr std::size_t headerSize =
+        (sizeof(Header) + unitSize - 1) / unitSize * unitSize;
+};
+
+// Recycles small blocks of memory through per-thread free lists, one per
+// size class. A thread whose list grows long hands a batch of blocks to a
+// shared depot, where threads whose list runs dry pick them up; that way,
+// memory allocated on one thread and freed on another comes back around
+// instead of piling up. Every block is allocated on its own, so they can
+// always be freed with `::operator delete` instead.
+class Recycler final {
+public:
+    static constexpr std::size_t numClasses = 6;  // 16 to 512 bytes
+    static constexpr std::size_t batchSize = 32;
+    static constexpr std::size_t maxDepotBatches = 256;  // per size class
+
+    static void * allocate(std::size_t bytes)
+    {
+        const auto c = sizeClass(bytes);
+        if (c == numClasses) {
+            return ::operator new(bytes);
+        }
+        if (!cacheGone()) {
+            auto &cache = threadCache();
+            if (cache.heads[c] == nullptr) {
+                refill(cache, c);
+            }
+            if (const auto block = cache.heads[c]) {
+                cache.heads[c] = block->next;
+                --cache.counts[c];
+                return block;
+            }
+        }
+        return ::operator new(classBytes(c));
+    }
+
+    static void deallocate(void *p, std::size_t bytes)
+    {
+        const auto c = sizeClass(bytes);
+        if (c == numClasses || cacheGone()) {
+            ::operator delete(p);
+            return;
+        }
+        auto &cache = threadCache();
+        const auto block = static_cast<FreeBlock *>(p);
+        block->next = cache.heads[c];
+        cache.heads[c] = block;
+        if (++cache.counts[c] > 2 * batchSize) {
+            spill(cache, c);
+        }
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    struct ThreadCache {
+        std::array<FreeBlock *, numClasses> heads{};
+        std::array<std::size_t, numClasses> counts{};
+
+        ~ThreadCache()
+        {
+            for (auto head: heads) {
+                while (head) {
+                    const auto next = head->next;
+                    ::operator delete(head);
+                    head = next;
+                }
+            }
+            cacheGone() = true;
+        }
+    };
+
+    struct Depot {
+        std::mutex mutex;
+        std::array<std::vector<FreeBlock *>, numClasses> batches;
+    };
+
+    static std::size_t sizeClass(std::size_t bytes)
+    {
+        std::size_t c = 0;
+        while (c < numClasses && classBytes(c) < bytes) {
+            ++c;
+        }
+        return c;
+    }
+
+    static std::size_t classBytes(std::size_t c)
+    {
+        return std::size_t{16} << c;
+    }
+
+    static ThreadCache & threadCache()
+    {
+        static thread_local ThreadCache cache;
+        return cache;
+    }
+
+    // Whether the calling thread's cache has been destroyed, as it is on
+    // the way out.
+    static bool & cacheGone()
+    {
+        static thread_local bool gone = false;
+        return gone;
+    }
+
+    // Never destroyed, as threads may still give back batches while the
+    // program exits.
+    static Depot & depot()
+    {
+        static Depot &depot = *new Depot;
+        return depot;
+    }
+
+    static void refill(ThreadCache &cache, std::size_t c)
+    {
+        auto &d = depot();
+        std::unique_lock<std::mutex> lk{d.mutex};
+        if (!d.batches[c].empty()) {
+            cache.heads[c] = d.batches[c].back();
+            cache.counts[c] = batchSize;
+            d.batches[c].pop_back();
+        }
+    }
+
+    // Moves `batchSize` blocks from the cache to the depot, or frees them
+    // if the depot is full.
+    static void spill(ThreadCache &cache, std::size_t c)
+    {
+        const auto batch = cache.heads[c];
+        auto last = batch;
+        for (std::size_t i = 1; i < batchSize; ++i) {
+            last = last->next;
+        }
+        cache.heads[c] = last->next;
+        cache.counts[c] -= batchSize;
+        last->next = nullptr;
+
+        auto &d = depot();
+        {
+            std::unique_lock<std::mutex> lk{d.mutex};
+            if (d.batches[c].size() < maxDepotBatches) {
+                d.batches[c].emplace_back(batch);
+                return;
+            }
+        }
+        for (auto block = batch; block; ) {
+            const auto next = block->next;
+            ::operator delete(block);
+            block = next;
+        }
+    }
+};
+
+inline void cpuRelax()
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __builtin_ia32_pause();
+#else
+    std::atomic_signal_fence(std::memory_order_acquire);
+#endif
+}
+
+// Waits for an event count according to a `WaitStrategy`. Not thread-safe;
+// each worker has its own, so that adaptive spinning learns per worker.
+class IdleWait {
+public:
+    IdleWait(WaitStrategy strategy, std::size_t spinCount)
+        : strategy_{strategy},
+          spinCount_{strategy == WaitStrategy::Adaptive
+              ? std::min(std::max(spinCount, std::size_t{minSpinCount}),
+                  std::size_t{maxSpinCount})
+              : spinCount}
+    {
+    }
+
+    // Ends a wait begun with `events.prepareWait()`, which returned `key`.
+    // Returns false if `deadline` passed without a notification.
+    bool operator()(
+            EventCount &events,
+            EventCount::Key key,
+            std::chrono::steady_clock::time_point deadline)
+    {
+        return wait(strategy_, events, key, deadline);
+    }
+
+    std::size_t spinCount() const
+    {
+        return spinCount_;
+    }
+
+protected:
+    bool wait(
+            WaitStrategy strategy,
+            EventCount &events,
+            EventCount::Key key,
+            std::chrono::steady_clock::time_point deadline)
+    {
+        switch (strategy) {
+        case WaitStrategy::Block:
+            break;
+        case WaitStrategy::SpinThenPark:
+            if (spin(events, key) > 0) {
+                events.cancelWait();
+                return true;
+            }
+            break;
+        case WaitStrategy::Yield:
+            return poll(events, key, deadline, true);
+        case WaitStrategy::BusyPoll:
+            return poll(events, key, deadline, false);
+        case WaitStrategy::Adaptive:
+            return adapt(events, key, deadline);
+        }
+        return events.commitWait(key, deadline);
+    }
+
+private:
+    static constexpr std::size_t minSpinCount = 16;
+    static constexpr std::size_t maxSpinCount = 1 << 17;
+
+    // Returns the number of iterations it took, or 0 if it gave up.
+    std::size_t spin(const EventCount &events, EventCount::Key key) const
+    {
+        for (std::size_t i = 1; i <= spinCount_; ++i) {
+            if (events.notified(key)) {
+                return i;
+            }
+            cpuRelax();
+        }
+        return 0;
+    }
+
+    bool poll(
+            EventCount &events,
+            EventCount::Key key,
+            std::chrono::steady_clock::time_point deadline,
+            bool yield)
+    {
+        const bool timed =
+            deadline != std::chrono::steady_clock::time_point::max();
+        for (std::size_t i = 1; !events.notified(key); ++i) {
+            if (yield) {
+                std::this_thread::yield();
+            } else {
+                cpuRelax();
+            }
+            if (timed && i % 1024 == 0 &&
+                    std::chrono::steady_clock::now() >= deadline) {
+                events.cancelWait();
+                return false;
+            }
+        }
+        events.cancelWait();
+        return true;
+    }
+
+    // Spinning pays off if it finds work; sleeping pays off if the wait is
+    // long compared to a sleep/wake-up round trip. Work found while
+    // spinning pulls the spin count towards twice the iterations it took;
+    // being woken up shortly after going to sleep doubles it; a long sleep
+    // shrinks it.
+    bool adapt(
+            EventCount &events,
+            EventCount::Key key,
+            std::chrono::steady_clock::time_point deadline)
+    {
+        const auto spun = spin(events, key);
+        bool woken = true;
+        if (spun > 0) {
+            events.cancelWait();
+            const auto target = std::min(2 * spun,
+                    std::size_t{maxSpinCount});
+            if (target > spinCount_) {
+                spinCount_ += (target - spinCount_) / 8;
+            } else {
+                spinCount_ -= (spinCount_ - target) / 8;
+            }
+        } else {
+            const auto parked = std::chrono::steady_clock::now();
+            woken = events.commitWait(key, deadline);
+            if (woken && std::chrono::steady_clock::now() - parked <
+                    std::chrono::microseconds{50}) {
+                spinCount_ = std::min(2 * spinCount_,
+                        std::size_t{maxSpinCount});
+            } else {
+                spinCount_ -= spinCount_ / 8;
+            }
+        }
+        spinCount_ = std::max(spinCount_, std::size_t{minSpinCount});
+        return woken;
+    }
+
+    const WaitStrategy strategy_;
+    std::size_t spinCount_;
+};
+
+// Always waits according to `S`, whatever the pool was configured with, so
+// that the choice is made at compile time.
+template <WaitStrategy S>
+class FixedIdleWait final : public IdleWait {
+public:
+    FixedIdleWait(WaitStrategy, std::size_t spinCount)
+        : IdleWait{S, spinCount}
+    {
+    }
+
+    bool operator()(
+            EventCount &events,
+            EventCount::Key key,
+            std::chrono::steady_clock::time_point deadline)
+    {
+        return wait(S, events, key, deadline);
+    }
+};
+
+// A queued task, along with when it was queued if the pool keeps track.
+template <typename T, bool timed>
+struct QueueEntry {
+    QueueEntry() = default;
+
+    template <typename U>
+    QueueEntry(U &&task, std::chrono::steady_clock::rep enqueued)
+        : task(std::forward<U>(task)), enqueued_{enqueued}
+    {
+    }
+
+    std::chrono::steady_clock::rep enqueued() const
+    {
+        return enqueued_;
+    }
+
+    T task;
+
+private:
+    std::chrono::steady_clock::rep enqueued_ = 0;
+};
+
+template <typename T>
+struct QueueEntry<T, false> {
+    QueueEntry() = default;
+
+    template <typename U>
+    QueueEntry(U &&task, std::chrono::steady_clock::rep)
+        : task(std::forward<U>(task))
+    {
+    }
+
+    std::chrono::steady_clock::rep enqueued() const
+    {
+        return 0;
+    }
+
+    T task;
+};
+
+// A fixed number of default-constructed `T`, allocated through a pool's
+// allocator, for state whose type does not depend on the allocator.
+template <typename T>
+class AllocatedArray final {
+public:
+    template <typename Alloc>
+    AllocatedArray(std::size_t size, const Alloc &alloc) : size_{size}
+    {
+        using Traits = typename std::allocator_traits<Alloc>::template
+            rebind_traits<T>;
+        typename Traits::allocator_type a(alloc);
+        data_ = Traits::allocate(a, size);
+        std::size_t i = 0;
+        try {
+            for (; i < size; ++i) {
+                Traits::construct(a, data_ + i);
+            }
+        } catch (...) {
+            destroy(a, i);
+            throw;
+        }
+        free_ = [a](T *data, std::size_t n) mutable {
+            AllocatedArray::destroy<Traits>(a, data, n);
+        };
+    }
+
+    ~AllocatedArray()
+    {
+        free_(data_, size_);
+    }
+
+    AllocatedArray(const AllocatedArray &other) = delete;
+    AllocatedArray & operator=(const AllocatedArray &other) = delete;
+
+    T & operator[](std::size_t i) const
+    {
+        return data_[i];
+    }
+
+private:
+    template <typename A>
+    void destroy(A &a, std::size_t n)
+    {
+        destroy<std::allocator_traits<A>>(a, data_, n);
+    }
+
+    template <typename Traits, typename A>
+    static void destroy(A &a, T *data, std::size_t n)
+    {
+        for (auto i = n; i > 0; --i) {
+            Traits::destroy(a, data + i - 1);
+        }
+        Traits::deallocate(a, data, n);
+    }
+
+    const std::size_t size_;
+    T *data_ = nullptr;
+    std::function<void(T *, std::size_t)> free_;
+};
+
+// The shared state of a `BulkFuture`: one buffer with a slot for the result
+// of each task, and a single count of completed tasks. The slots also
+// record the order in which the tasks completed.
+template <typename R>
+class BulkState final {
+public:
+    template <typename Alloc>
+    BulkState(std::size_t size, const Alloc &alloc)
+        : size_{size}, slots_{size, alloc}
+    {
+    }
+
+    ~BulkState()
+    {
+        for (std::size_t i = 0; i < size_; ++i) {
+            if (slots_[i].hasValue) {
+                value(i).~R();
+            }
+        }
+    }
+
+    BulkState(const BulkState &other) = delete;
+    BulkState & operator=(const BulkState &other) = delete;
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    std::size_t numCompleted() const
+    {
+        return numCompleted_.load(std::memory_order_acquire);
+    }
+
+    // Runs `task` for slot `i`, unless it already ran or was abandoned.
+    template <typename F>
+    void run(std::size_t i, const F &task)
+    {
+        if (!claim(i)) {
+            return;
+        }
+        auto &slot = slots_[i];
+        try {
+            new (&slot.value) R(task());
+            slot.hasValue = true;
+        } catch (...) {
+            slot.error = std::current_exception();
+        }
+        complete(i);
+    }
+
+    // The tasks for slots [`first`, `last`) are counted as held by
+    // `first`; once the last copy lets go, the slots that never ran get a
+    // broken promise.
+    void hold(std::size_t first)
+    {
+        slots_[first].refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release(std::size_t first, std::size_t last)
+    {
+        if (slots_[first].refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        for (auto i = first; i < last; ++i) {
+            if (claim(i)) {
+                slots_[i].error = std::make_exception_ptr(std::future_error{
+                        std::future_errc::broken_promise});
+                complete(i);
+            }
+        }
+    }
+
+    // Waits for the task of slot `i`, and returns its result or throws its
+    // exception.
+    R & get(std::size_t i)
+    {
+        auto &slot = slots_[i];
+        await(i, [&slot] {
+            return slot.ready.load(std::memory_order_acquire);
+        }, std::chrono::steady_clock::time_point::max());
+        if (slot.error) {
+            std::rethrow_exception(slot.error);
+        }
+        return value(i);
+    }
+
+    // Waits for the `k`-th task to complete, and returns its slot.
+    std::size_t completed(std::size_t k)
+    {
+        std::size_t i = 0;
+        auto &slot = slots_[k];
+        await(k, [&slot, &i] {
+            i = slot.order.load(std::memory_order_acquire);
+            return i > 0;
+        }, std::chrono::steady_clock::time_point::max());
+        return i - 1;
+    }
+
+    // Returns false if `deadline` passed first.
+    bool wait(std::chrono::steady_clock::time_point deadline)
+    {
+        return await(size_, [this] { return numCompleted() == size_; },
+                deadline);
+    }
+
+private:
+    struct Slot {
+        typename std::aligned_storage<sizeof(R), alignof(R)>::type value;
+        bool hasValue = false;
+        std::exception_ptr error;
+        std::atomic<bool> claimed{false};
+        std::atomic<bool> ready{false};
+        std::atomic<std::size_t> order{0};  // 1 + slot of the k-th to complete
+        std::atomic<std::size_t> refs{0};
+        std::atomic<bool> watched{false};  // someone waits on this index
+    };
+
+    R & value(std::size_t i)
+    {
+        return *reinterpret_cast<R *>(&slots_[i].value);
+    }
+
+    bool claim(std::size_t i)
+    {
+        return !slots_[i].claimed.exchange(true, std::memory_order_acq_rel);
+    }
+
+    // Wakes waiters only if they wait for this slot, for the `k`-th task
+    // to complete, or for all of them.
+    void complete(std::size_t i)
+    {
+        slots_[i].ready.store(true, std::memory_order_release);
+        const auto k = numCompleted_.fetch_add(1, std::memory_order_acq_rel);
+        slots_[k].order.store(i + 1, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (k + 1 == size_ ||
+                slots_[i].watched.load(std::memory_order_relaxed) ||
+                slots_[k].watched.load(std::memory_order_relaxed)) {
+            events_.notifyAll();
+        }
+    }
+
+    // Waits until `done`, as a waiter on index `i`; `size_` stands for
+    // all tasks.
+    template <typename P>
+    bool await(std::size_t i, const P &done,
+            std::chrono::steady_clock::time_point deadline)
+    {
+        if (done()) {
+            return true;
+        }
+        if (i < size_) {
+            slots_[i].watched.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+        while (!done()) {
+            const auto key = events_.prepareWait();
+            if (done()) {
+                events_.cancelWait();
+                break;
+            }
+            if (!events_.commitWait(key, deadline)) {
+                return done();
+            }
+        }
+        return true;
+    }
+
+    const std::size_t size_;
+    const AllocatedArray<Slot> slots_;
+    std::atomic<std::size_t> numCompleted_{0};
+    EventCount events_;
+};
+
+template <std::size_t... I>
+struct IndexSequence {
+};
+
+template <std::size_t N, std::size_t... I>
+struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, I...> {
+};
+
+template <std::size_t... I>
+struct MakeIndexSequence<0, I...> {
+    using type = IndexSequence<I...>;
+};
+
+// Room for the result of a callable, or the exception it threw.
+template <typename R>
+class ResultSlot final {
+public:
+    ResultSlot() = default;
+
+    ~ResultSlot()
+    {
+        if (hasValue_) {
+            value().~R();
+        }
+    }
+
+    ResultSlot(const ResultSlot &other) = delete;
+    ResultSlot & operator=(const ResultSlot &other) = delete;
+
+    template <typename F>
+    void run(const F &f)
+    {
+        try {
+            new (&storage_) R(f());
+            hasValue_ = true;
+        } catch (...) {
+            error_ = std::current_exception();
+        }
+    }
+
+    const std::exception_ptr & error() const
+    {
+        return error_;
+    }
+
+    R && take()
+    {
+        return std::move(value());
+    }
+
+    // Empties the slot for reuse.
+    void reset()
+    {
+        if (hasValue_) {
+            value().~R();
+            hasValue_ = false;
+        }
+        error_ = nullptr;
+    }
+
+private:
+    R & value()
+    {
+        return *reinterpret_cast<R *>(&storage_);
+    }
+
+    typename std::aligned_storage<sizeof(R), alignof(R)>::type storage_;
+    bool hasValue_ = false;
+    std::exception_ptr error_;
+};
+
+// A callable returning void has no result to keep, only an exception.
+template <>
+class ResultSlot<void> final {
+public:
+    ResultSlot() = default;
+
+    ResultSlot(const ResultSlot &other) = delete;
+    ResultSlot & operator=(const ResultSlot &other) = delete;
+
+    template <typename F>
+    void run(const F &f)
+    {
+        try {
+            f();
+        } catch (...) {
+            error_ = std::current_exception();
+        }
+    }
+
+    const std::exception_ptr & error() const
+    {
+        return error_;
+    }
+
+    void reset()
+    {
+        error_ = nullptr;
+    }
+
+private:
+    std::exception_ptr error_;
+};
+
+// The single shared state of `TaskPool::invokeAll`: the callables, a slot
+// for each result, and which callables someone took on, be it a worker or
+// the calling thread.
+template <typename... F>
+class InvokeState final {
+public:
+    using Results = std::tuple<typename std::conditional<
+        std::is_void<typename std::result_of<const F &()>::type>::value,
+        NoResult, typename std::result_of<const F &()>::type>::type...>;
+
+    explicit InvokeState(const F &... fs)
+        : fs_{fs...}, claimed_{}, remaining_{sizeof...(F)}
+    {
+    }
+
+    // Runs the `I`-th callable, unless someone else took it on.
+    template <std::size_t I>
+    void run()
+    {
+        if (claimed_[I].exchange(true, std::memory_order_acq_rel)) {
+            return;
+        }
+        std::get<I>(slots_).run(std::get<I>(fs_));
+        if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            events_.notifyAll();
+        }
+    }
+
+    // Runs every callable nobody took on yet, in order, and waits for the
+    // others. Rethrows the exception of the first callable that threw.
+    Results join()
+    {
+        return join(typename MakeIndexSequence<sizeof...(F)>::type{});
+    }
+
+private:
+    template <std::size_t... I>
+    Results join(IndexSequence<I...>)
+    {
+        const int ran[] = {(run<I>(), 0)...};
+        (void)ran;
+
+        while (remaining_.load(std::memory_order_acquire) > 0) {
+            const auto key = events_.prepareWait();
+            if (remaining_.load(std::memory_order_acquire) == 0) {
+                events_.cancelWait();
+                break;
+            }
+            events_.commitWait(key,
+                    std::chrono::steady_clock::time_point::max());
+        }
+
+        for (const auto &error: {std::get<I>(slots_).error()...}) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+        return Results{take(std::get<I>(slots_))...};
+    }
+
+    template <typename R>
+    static R && take(ResultSlot<R> &slot)
+    {
+        return slot.take();
+    }
+
+    static NoResult take(ResultSlot<void> &)
+    {
+        return {};
+    }
+
+    const std::tuple<F...> fs_;
+    std::tuple<ResultSlot<typename std::result_of<const F &()>::type>...>
+        slots_;
+    std::array<std::atomic<bool>, sizeof...(F)> claimed_;
+    std::atomic<std::size_t> remaining_;
+    EventCount events_;
+};
+
+template <typename State, std::size_t I>
+class InvokeTask final {
+public:
+    explicit InvokeTask(std::shared_ptr<State> state)
+        : state_{std::move(state)}
+    {
+    }
+
+    void operator()() const
+    {
+        state_->template run<I>();
+    }
+
+private:
+    std::shared_ptr<State> state_;
+};
+
+// What the tasks of a synchronous dispatch share with the dispatching
+// thread: how many copies of them are left, how many ran, and the first
+// exception one threw. The dispatching thread holds a copy of its own until
+// it waits, and only returns once every copy is gone, as they refer to its
+// stack; only the last copy to go takes the lock.
+class SyncState final {
+public:
+    void hold()
+    {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release()
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::unique_lock<std::mutex> lk{m_};
+            done_ = true;
+            cv_.notify_all();
+        }
+    }
+
+    template <typename F>
+    void run(const F &task)
+    {
+        try {
+            task();
+        } catch (...) {
+            std::unique_lock<std::mutex> lk{m_};
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+        numRun_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Lets go of the dispatching thread's copy, and waits for the others.
+    void wait()
+    {
+        release();
+        std::unique_lock<std::mutex> lk{m_};
+        cv_.wait(lk, [this] { return done_; });
+    }
+
+    // Rethrows the first exception a task threw, or throws a broken
+    // promise if fewer than `n` tasks ran. Only valid after `wait`.
+    void check(std::size_t n) const
+    {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        if (numRun_.load(std::memory_order_relaxed) < n) {
+            throw std::future_error{std::future_errc::broken_promise};
+        }
+    }
+
+private:
+    std::atomic<std::size_t> refs_{1};
+    std::atomic<std::size_t> numRun_{0};
+    std::exception_ptr error_;
+    std::mutex m_;
+    std::condition_variable cv_;
+    bool done_ = false;
+};
+
+// The results of synchronous dispatches of tasks without any.
+struct NoOutput {
+    NoOutput operator+(std::size_t) const
+    {
+        return *this;
+    }
+};
+
+// Runs a task of a synchronous dispatch and assigns its result to `*out`.
+template <typename R, typename Out>
+class SyncTask final {
+public:
+    SyncTask(SyncState &state, Out out, Task<R> task)
+        : state_{&state}, out_(out), task_{std::move(task)}
+    {
+        state_->hold();
+    }
+
+    SyncTask(const SyncTask &other)
+        : state_{other.state_}, out_(other.out_), task_{other.task_}
+    {
+        state_->hold();
+    }
+
+    SyncTask(SyncTask &&other)
+        : state_{other.state_}, out_(other.out_), task_{std::move(other.task_)}
+    {
+        other.state_ = nullptr;
+    }
+
+    ~SyncTask()
+    {
+        if (state_) {
+            state_->release();
+        }
+    }
+
+    SyncTask & operator=(const SyncTask &other) = delete;
+
+    void operator()() const
+    {
+        state_->run([this] { assign(std::is_void<R>{}); });
+    }
+
+private:
+    void assign(std::false_type) const
+    {
+        *out_ = task_();
+    }
+
+    void assign(std::true_type) const
+    {
+        task_();
+    }
+
+    SyncState *state_;
+    Out out_;
+    Task<R> task_;
+};
+
+// The slots of a `mapBounded`, one for each input in flight, and the list
+// of slots whose tasks are gone. A slot is put on the list only once every
+// copy of its task is destroyed, run or not, so the calling thread may reuse
+// it right away.
+template <typename T, typename R>
+class MapState final {
+public:
+    struct Slot {
+        ResultSlot<T> input;
+        ResultSlot<R> output;
+        std::atomic<std::size_t> refs{0};
+        bool ran = false;
+    };
+
+    template <typename Alloc>
+    MapState(std::size_t n, const Alloc &alloc) : slots_{n, alloc}
+    {
+        ready_.reserve(n);
+    }
+
+    Slot & slot(std::size_t i)
+    {
+        return slots_[i];
+    }
+
+    void hold(std::size_t i)
+    {
+        slots_[i].refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release(std::size_t i)
+    {
+        auto &slot = slots_[i];
+        if (slot.refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        if (!slot.ran) {
+            slot.output.run([]() -> R {
+                throw std::future_error{std::future_errc::broken_promise};
+            });
+        }
+        std::lock_guard<std::mutex> lk{m_};
+        ready_.push_back(i);
+        cv_.notify_one();
+    }
+
+    // Waits for at least one slot to be ready, and swaps the ready slots
+    // into the empty `out`.
+    void take(std::vector<std::size_t> &out)
+    {
+        std::unique_lock<std::mutex> lk{m_};
+        cv_.wait(lk, [this] { return !ready_.empty(); });
+        out.swap(ready_);
+    }
+
+private:
+    const AllocatedArray<Slot> slots_;
+    std::vector<std::size_t> ready_;
+    std::mutex m_;
+    std::condition_variable cv_;
+};
+
+// Passes the result in `slot` to the sink of a `mapBounded`, with no
+// argument if the function returns void.
+template <typename R, typename Sink>
+void sinkResult(const Sink &sink, ResultSlot<R> &slot)
+{
+    sink(slot.take());
+}
+
+template <typename Sink>
+void sinkResult(const Sink &sink, ResultSlot<void> &)
+{
+    sink();
+}
+
+// Applies the function of a `mapBounded` to the input in one slot.
+template <typename T, typename R, typename F>
+class MapTask final {
+public:
+    MapTask(MapState<T, R> &state, std::size_t i, const F &fn)
+        : state_{&state}, i_{i}, fn_{&fn}
+    {
+        state_->hold(i_);
+    }
+
+    MapTask(const MapTask &other)
+        : state_{other.state_}, i_{other.i_}, fn_{other.fn_}
+    {
+        state_->hold(i_);
+    }
+
+    MapTask(MapTask &&other)
+        : state_{other.state_}, i_{other.i_}, fn_{other.fn_}
+    {
+        other.state_ = nullptr;
+    }
+
+    ~MapTask()
+    {
+        if (state_) {
+            state_->release(i_);
+        }
+    }
+
+    MapTask & operator=(const MapTask &other) = delete;
+
+    void operator()() const
+    {
+        auto &slot = state_->slot(i_);
+        slot.output.run([this, &slot] { return (*fn_)(slot.input.take()); });
+        slot.ran = true;
+    }
+
+private:
+    MapState<T, R> *state_;
+    std::size_t i_;
+    const F *fn_;
+};
+
+// Runs the task of one slot of a bulk dispatch. If every copy is destroyed
+// without running it, for example because the pool was shut down, the slot
+// gets a broken promise.
+template <typename R>
+class BulkTask final {
+public:
+    BulkTask(std::shared_ptr<BulkState<R>> state, std::size_t i,
+            Task<R> task)
+        : state_{std::move(state)}, i_{i}, task_{std::move(task)}
+    {
+        state_->hold(i_);
+    }
+
+    BulkTask(const BulkTask &other)
+        : state_{other.state_}, i_{other.i_}, task_{other.task_}
+    {
+        state_->hold(i_);
+    }
+
+    BulkTask(BulkTask &&other)
+        : state_{std::move(other.state_)}, i_{other.i_},
+          task_{std::move(other.task_)}
+    {
+    }
+
+    ~BulkTask()
+    {
+        if (state_) {
+            state_->release(i_, i_ + 1);
+        }
+    }
+
+    BulkTask & operator=(const BulkTask &other) = delete;
+
+    void operator()() const
+    {
+        state_->run(i_, task_);
+    }
+
+private:
+    std::shared_ptr<BulkState<R>> state_;
+    std::size_t i_;
+    Task<R> task_;
+};
+
+// Runs the tasks of every slot of a bulk dispatch, one after the other;
+// like `BulkTask` otherwise.
+template <typename R, typename Tasks>
+class SerialBulkTask final {
+public:
+    SerialBulkTask(std::shared_ptr<BulkState<R>> state,
+            std::shared_ptr<const Tasks> tasks)
+        : state_{std::move(state)}, tasks_{std::move(tasks)}
+    {
+        state_->hold(0);
+    }
+
+    SerialBulkTask(const SerialBulkTask &other)
+        : state_{other.state_}, tasks_{other.tasks_}
+    {
+        state_->hold(0);
+    }
+
+    SerialBulkTask(SerialBulkTask &&other)
+        : state_{std::move(other.state_)}, tasks_{std::move(other.tasks_)}
+    {
+    }
+
+    ~SerialBulkTask()
+    {
+        if (state_) {
+            state_->release(0, state_->size());
+        }
+    }
+
+    SerialBulkTask & operator=(const SerialBulkTask &other) = delete;
+
+    void operator()() const
+    {
+        for (std::size_t i = 0; i < tasks_->size(); ++i) {
+            state_->run(i, (*tasks_)[i]);
+        }
+    }
+
+private:
+    std::shared_ptr<BulkState<R>> state_;
+    std::shared_ptr<const Tasks> tasks_;
+};
+
+}
+
+// Idle wait policies for `BasicTaskPool`: the strategy chosen at run time
+// with `TaskPoolOptions::waitStrategy`, or `S` regardless.
+using ConfiguredIdleWait = detail::IdleWait;
+
+template <WaitStrategy S>
+using FixedIdleWait = detail::FixedIdleWait<S>;
+
+// A stateless allocator that recycles small blocks through per-thread free
+// lists, so that steady-state allocation does not go to the heap; see
+// `DefaultTaskPoolPolicy::Allocator`. Memory freed on another thread than
+// it was allocated on is recycled as well.
+template <typename T>
+struct RecyclingAllocator {
+    using value_type = T;
+
+    RecyclingAllocator() = default;
+
+    template <typename U>
+    RecyclingAllocator(const RecyclingAllocator<U> &)
+    {
+    }
+
+    T * allocate(std::size_t n)
+    {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+            throw std::bad_alloc{};
+        }
+        return static_cast<T *>(detail::Recycler::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n)
+    {
+        detail::Recycler::deallocate(p, n * sizeof(T));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const RecyclingAllocator<T> &, const RecyclingAllocator<U> &)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const RecyclingAllocator<T> &, const RecyclingAllocator<U> &)
+{
+    return false;
+}
+
+// Queue traits that take the queue blocks from `Allocator`, and count them
+// in the queue memory stats; see `DefaultTaskPoolPolicy::QueueTraits`.
+template <typename Allocator>
+using CountingQueueTraits = detail::CountingQueueTraits<Allocator>;
+
+// How much a task pool keeps track of beyond what it needs to work.
+enum class Instrumentation {
+    // Only thread, idle and queue counts, and sleeps and wake-ups. Queued
+    // tasks are not timestamped, which rules out load shedding and
+    // `GrowthPolicy::WaitTime`.
+    Minimal,
+    Full
+};
+
+// The compile-time configuration of a `BasicTaskPool`. Custom policies
+// derive from it and override what they need to.
+struct DefaultTaskPoolPolicy {
+    // How queued tasks are stored: a default-constructible, movable
+    // callable that can be constructed from any `Task<void>` or lambda.
+    using Task = gungnir::Task<void>;
+
+    // What the pool allocates its own bookkeeping with, rebound as needed:
+    // promises and their shared states, result slots, and the task lists of
+    // bulk and serial dispatches. Must be default-constructible.
+    // `RecyclingAllocator` keeps most steady-state dispatches away from the
+    // heap. It cannot reach into `Task`, though: `std::function` allocates
+    // the closure `dispatch<R>` wraps each task in on its own, as it is too
+    // big to be stored in place.
+    using Allocator = std::allocator<char>;
+
+    // The queue, which must have the interface of moodycamel's, and its
+    // traits (block size, index sizes, and so on). The queue memory stats
+    // stay at 0 with traits that do not count allocations. The default
+    // traits take the queue blocks from `Allocator`; policies with another
+    // allocator use `CountingQueueTraits<Allocator>` for the same.
+    using QueueTraits = CountingQueueTraits<Allocator>;
+
+    template <typename T>
+    using Queue = moodycamel::ConcurrentQueue<T, QueueTraits>;
+
+    using IdleWait = ConfiguredIdleWait;
+
+    static constexpr Instrumentation instrumentation = Instrumentation::Full;
+};
+
+// The results of a bulk dispatch, see `TaskPool::dispatchBulk`: one buffer
+// for all of them, and a single count of completed tasks. Unlike a vector
+// of futures, results are read in place, any number of times; copies share
+// them. Iterating yields the indices of the tasks in the order they
+// complete, waiting for each.
+template <typename R>
+class BulkFuture final {
+public:
+    class iterator final {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::size_t;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::size_t *;
+        using reference = std::size_t;
+
+        std::size_t operator*() const
+        {
+            return state_->completed(k_);
+        }
+
+        iterator & operator++()
+        {
+            ++k_;
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            auto old = *this;
+            ++k_;
+            return old;
+        }
+
+        bool operator==(const iterator &other) const
+        {
+            return k_ == other.k_;
+        }
+
+        bool operator!=(const iterator &other) const
+        {
+            return k_ != other.k_;
+        }
+
+    private:
+        friend class BulkFuture;
+
+        iterator(detail::BulkState<R> *state, std::size_t k)
+            : state_{state}, k_{k}
+        {
+        }
+
+        detail::BulkState<R> *state_;
+        std::size_t k_;
+    };
+
+    BulkFuture() = default;
+
+    explicit BulkFuture(std::shared_ptr<detail::BulkState<R>> state)
+        : state_{std::move(state)}
+    {
+    }
+
+    bool valid() const
+    {
+        return state_ != nullptr;
+    }
+
+    std::size_t size() const
+    {
+        return state_ ? state_->size() : 0;
+    }
+
+    // How many tasks have completed so far.
+    std::size_t numReady() const
+    {
+        return state_ ? state_->numCompleted() : 0;
+    }
+
+    bool ready() const
+    {
+        return numReady() == size();
+    }
+
+    void wait() const
+    {
+        checkState();
+        state_->wait(std::chrono::steady_clock::time_point::max());
+    }
+
+    // Returns whether every task completed within `timeout`.
+    template <typename Rep, typename Period>
+    bool waitFor(const std::chrono::duration<Rep, Period> &timeout) const
+    {
+        checkState();
+        return state_->wait(std::chrono::steady_clock::now() + timeout);
+    }
+
+    // Waits for the `i`-th task, and returns its result or throws its
+    // exception.
+    R & get(std::size_t i) const
+    {
+        checkState();
+        if (i >= state_->size()) {
+            throw std::out_of_range{"no such task"};
+        }
+        return state_->get(i);
+    }
+
+    R & operator[](std::size_t i) const
+    {
+        return get(i);
+    }
+
+    iterator begin() const
+    {
+        return {state_.get(), 0};
+    }
+
+    iterator end() const
+    {
+        return {state_.get(), size()};
+    }
+
+private:
+    void checkState() const
+    {
+        if (!state_) {
+            throw std::future_error{std::future_errc::no_state};
+        }
+    }
+
+    std::shared_ptr<detail::BulkState<R>> state_;
+};
+
+// Results in the order their tasks complete, as in Java's
+// ExecutorCompletionService: a batch dispatched with
+// `TaskPool::dispatch(first, last, completions)` queues each result here
+// as soon as it is ready, under the index of its task in the batch. Any
+// number of threads may queue and take results; `R` must be
+// default-constructible. Tasks dropped without running, for example by
+// `shutdownNow`, show up with a broken promise.
+template <typename R>
+class CompletionQueue final {
+    static_assert(std::is_default_constructible<R>::value,
+            "the results of a CompletionQueue must be default-constructible");
+
+public:
+    struct Completed {
+        std::size_t index = 0;
+        R value{};
+        std::exception_ptr error;
+
+        // The result, or the exception the task threw.
+        R & get()
+        {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            return value;
+        }
+    };
+
+    CompletionQueue() = default;
+
+    CompletionQueue(const CompletionQueue &other) = delete;
+    CompletionQueue & operator=(const CompletionQueue &other) = delete;
+
+    // Runs `task`, and queues its result or exception under `index`.
+    template <typename F>
+    void complete(std::size_t index, const F &task)
+    {
+        Completed c;
+        c.index = index;
+        try {
+            c.value = task();
+        } catch (...) {
+            c.error = std::current_exception();
+        }
+        queue_.enqueue(std::move(c));
+        events_.notify();
+    }
+
+    // Waits for the next result.
+    Completed pop()
+    {
+        Completed c;
+        popUntil(c, std::chrono::steady_clock::time_point::max());
+        return c;
+    }
+
+    bool tryPop(Completed &c)
+    {
+        return queue_.try_dequeue(c);
+    }
+
+    // Returns false if no result arrived within `timeout`.
+    template <typename Rep, typename Period>
+    bool popFor(const std::chrono::duration<Rep, Period> &timeout,
+            Completed &c)
+    {
+        return popUntil(c, std::chrono::steady_clock::now() + timeout);
+    }
+
+    // Waits for at least one result, and takes up to `max` results at once
+    // into `out`, an output iterator of `Completed`. Returns how many it
+    // took.
+    template <typename Out>
+    std::size_t popBulk(Out out, std::size_t max)
+    {
+        for (;;) {
+            const auto n = queue_.try_dequeue_bulk(out, max);
+            if (n > 0 || max == 0) {
+                return n;
+            }
+            const auto key = events_.prepareWait();
+            if (queue_.size_approx() > 0) {
+                events_.cancelWait();
+                continue;
+            }
+            events_.commitWait(key,
+                    std::chrono::steady_clock::time_point::max());
+        }
+    }
+
+    template <typename Out>
+    std::size_t tryPopBulk(Out out, std::size_t max)
+    {
+        return queue_.try_dequeue_bulk(out, max);
+    }
+
+    std::size_t sizeApprox() const
+    {
+        return queue_.size_approx();
+    }
+
+private:
+    bool popUntil(Completed &c, std::chrono::steady_clock::time_point deadline)
+    {
+        while (!queue_.try_dequeue(c)) {
+            const auto key = events_.prepareWait();
+            if (queue_.try_dequeue(c)) {
+                events_.cancelWait();
+                return true;
+            }
+            if (!events_.commitWait(key, deadline)) {
+                return queue_.try_dequeue(c);
+            }
+        }
+        return true;
+    }
+
+    moodycamel::ConcurrentQueue<Completed> queue_;
+    detail::EventCount events_;
+};
+
+namespace detail {
+
+// Shared by the tasks of a batch dispatched to a `CompletionQueue`. Each
+// task is counted as held by its copies; once the last copy of a task that
+// never ran lets go, its index is queued with a broken promise.
+template <typename R>
+class CompletionBatch final {
+public:
+    template <typename Alloc>
+    CompletionBatch(CompletionQueue<R> &completions, std::size_t size,
+            const Alloc &alloc)
+        : completions_{&completions}, slots_{size, alloc}
+    {
+    }
+
+    CompletionBatch(const CompletionBatch &other) = delete;
+    CompletionBatch & operator=(const CompletionBatch &other) = delete;
+
+    template <typename F>
+    void run(std::size_t i, const F &task)
+    {
+        if (claim(i)) {
+            completions_->complete(i, task);
+        }
+    }
+
+    void hold(std::size_t i)
+    {
+        slots_[i].refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release(std::size_t i)
+    {
+        if (slots_[i].refs.fetch_sub(1, std::memory_order_acq_rel) == 1 &&
+                claim(i)) {
+            completions_->complete(i, []() -> R {
+                throw std::future_error{std::future_errc::broken_promise};
+            });
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> refs{0};
+        std::atomic<bool> claimed{false};
+    };
+
+    bool claim(std::size_t i)
+    {
+        return !slots_[i].claimed.exchange(true, std::memory_order_acq_rel);
+    }
+
+    CompletionQueue<R> *const completions_;
+    const AllocatedArray<Slot> slots_;
+};
+
+// The task of index `i` in a batch dispatched to a `CompletionQueue`.
+template <typename R>
+class CompletionTask final {
+public:
+    CompletionTask(std::shared_ptr<CompletionBatch<R>> batch, std::size_t i,
+            Task<R> task)
+        : batch_{std::move(batch)}, i_{i}, task_{std::move(task)}
+    {
+        batch_->hold(i_);
+    }
+
+    CompletionTask(const CompletionTask &other)
+        : batch_{other.batch_}, i_{other.i_}, task_{other.task_}
+    {
+        batch_->hold(i_);
+    }
+
+    CompletionTask(CompletionTask &&other)
+        : batch_{std::move(other.batch_)}, i_{other.i_},
+          task_{std::move(other.task_)}
+    {
+    }
+
+    ~CompletionTask()
+    {
+        if (batch_) {
+            batch_->release(i_);
+        }
+    }
+
+    CompletionTask & operator=(const CompletionTask &other) = delete;
+
+    void operator()() const
+    {
+        batch_->run(i_, task_);
+    }
+
+private:
+    std::shared_ptr<CompletionBatch<R>> batch_;
+    std::size_t i_;
+    Task<R> task_;
+};
+
+}
+
+// A once flag for `dispatchOnce`. Its state is checked on the dispatching
+// thread, so once the task has been dispatched further calls cost a single
+// acquire load and never touch the queue. `future` completes when the task
+// has run, with its exception if it threw, or with a broken promise if it
+// was dropped without running, for example by `shutdownNow`. Either way the
+// task is never attempted again.
+class OnceFlag final {
+public:
+    OnceFlag()
+        : promise_{std::make_shared<std::promise<void>>()},
+          future_{promise_->get_future().share()}
+    {
+    }
+
+    OnceFlag(const OnceFlag &other) = delete;
+    OnceFlag & operator=(const OnceFlag &other) = delete;
+
+    // Whether the task has completed, successfully or not. `future` becomes
+    // ready right after.
+    bool done() const
+    {
+        return state_.load(std::memory_order_acquire) == Done;
+    }
+
+    const std::shared_future<void> & future() const
+    {
+        return future_;
+    }
+
+private:
+    template <typename P>
+    friend class BasicTaskPool;
+
+    enum : int {
+        Idle,
+        Pending,
+        Done
+    };
+
+    // Shared by the copies of a flag's runner. Completes the flag with a
+    // broken promise when the last copy goes, unless one of them ran. The
+    // flag is not touched after it is marked done, so its owner may destroy
+    // it as soon as `done` returns true.
+    class Guard final {
+    public:
+        explicit Guard(OnceFlag &flag) : flag_{&flag}, promise_{flag.promise_}
+        {
+        }
+
+        Guard(const Guard &other) = delete;
+        Guard & operator=(const Guard &other) = delete;
+
+        ~Guard()
+        {
+            if (!ran_) {
+                complete(std::make_exception_ptr(std::future_error{
+                            std::future_errc::broken_promise}));
+            }
+        }
+
+        void run(const Task<void> &task)
+        {
+            ran_ = true;
+            try {
+                task();
+            } catch (...) {
+                complete(std::current_exception());
+                return;
+            }
+            complete(nullptr);
+        }
+
+    private:
+        void complete(std::exception_ptr error)
+        {
+            flag_->state_.store(Done, std::memory_order_release);
+            if (error) {
+                promise_->set_exception(std::move(error));
+            } else {
+                promise_->set_value();
+            }
+        }
+
+        OnceFlag *flag_;
+        std::shared_ptr<std::promise<void>> promise_;
+        bool ran_ = false;
+    };
+
+    class Runner final {
+    public:
+        Runner(OnceFlag &flag, const Task<void> &task)
+            : guard_{std::make_shared<Guard>(flag)}, task_{task}
+        {
+        }
+
+        void operator()() const
+        {
+            guard_->run(task_);
+        }
+
+    private:
+        std::shared_ptr<Guard> guard_;
+        Task<void> task_;
+    };
+
+    // Claims the flag for the calling thread, unless it was claimed before.
+    bool claim()
+    {
+        int expected = Idle;
+        return state_.load(std::memory_order_acquire) == Idle &&
+            state_.compare_exchange_strong(expected, Pending,
+                    std::memory_order_acq_rel);
+    }
+
+    std::atomic<int> state_{Idle};
+    std::shared_ptr<std::promise<void>> promise_;
+    std::shared_future<void> future_;
+};
+
+// Deduplicates concurrent loads of the same key for `singleFlight`: while a
+// load of a key is in flight, further calls for that key share its future
+// instead of running another one. Entries live in a table split into shards
+// with a lock each, and are removed when their load completes, or, given a
+// `ttl`, kept that much longer so that the result is reused. Failed loads
+// are never kept. The group must outlive the loads dispatched through it.
+// `Clock` times the TTL; tests may substitute one they control.
+template <typename K, typename V, typename Hash = std::hash<K>,
+        typename Clock = std::chrono::steady_clock>
+class SingleFlight final {
+public:
+
+    static constexpr std::size_t numShards = 16;
+
+    explicit SingleFlight(
+            typename Clock::duration ttl = Clock::duration::zero())
+        : ttl_{ttl}
+    {
+    }
+
+    SingleFlight(const SingleFlight &other) = delete;
+    SingleFlight & operator=(const SingleFlight &other) = delete;
+
+    // Drops the kept result of `key`, if any; a load in flight is left alone.
+    void forget(const K &key)
+    {
+        auto &shard = shardOf(key);
+        std::lock_guard<std::mutex> lk{shard.m};
+        const auto it = shard.entries.find(key);
+        if (it != shard.entries.end() &&
+                it->second.expires != Clock::time_point::max()) {
+            shard.entries.erase(it);
+        }
+    }
+
+    // Loads in flight plus kept results, including expired results that
+    // have not been swept yet.
+    std::size_t size() const
+    {
+        std::size_t n = 0;
+        for (const auto &shard: shards_) {
+            std::lock_guard<std::mutex> lk{shard.m};
+            n += shard.entries.size();
+        }
+        return n;
+    }
+
+private:
+    template <typename P>
+    friend class BasicTaskPool;
+
+    struct Entry {
+        std::shared_future<V> future;
+        typename Clock::time_point expires;  // max while in flight
+    };
+
+    struct Shard {
+        mutable std::mutex m;
+        std::unordered_map<K, Entry, Hash> entries;
+        typename Clock::time_point nextSweep;
+    };
+
+    // A load of one key. If it is destroyed without having run, for example
+    // because the pool was shut down, its callers get a broken promise.
+    class Flight final {
+    public:
+        Flight(SingleFlight &group, const K &key) : group_{&group}, key_{key}
+        {
+        }
+
+        Flight(const Flight &other) = delete;
+        Flight & operator=(const Flight &other) = delete;
+
+        ~Flight()
+        {
+            if (!ran_) {
+                group_->finish(key_, false);
+                promise_.set_exception(std::make_exception_ptr(
+                            std::future_error{
+                                std::future_errc::broken_promise}));
+            }
+        }
+
+        std::shared_future<V> future()
+        {
+            return promise_.get_future().share();
+        }
+
+        // Updates the table before completing the future, so that callers
+        // may destroy the group once they have their results.
+        void run(const Task<V> &loader)
+        {
+            ran_ = true;
+            try {
+                auto value = loader();
+                group_->finish(key_, true);
+                promise_.set_value(std::move(value));
+            } catch (...) {
+                group_->finish(key_, false);
+                promise_.set_exception(std::current_exception());
+            }
+        }
+
+    private:
+        SingleFlight *group_;
+        K key_;
+        std::promise<V> promise_;
+        bool ran_ = false;
+    };
+
+    class Runner final {
+    public:
+        Runner(std::shared_ptr<Flight> flight, Task<V> loader)
+            : flight_{std::move(flight)}, loader_{std::move(loader)}
+        {
+        }
+
+        void operator()() const
+        {
+            flight_->run(loader_);
+        }
+
+    private:
+        std::shared_ptr<Flight> flight_;
+        Task<V> loader_;
+    };
+
+    // Sets `future` to that of the load of `key` in flight or kept, if
+    // there is one, and returns null. Otherwise starts a new flight, which
+    // the caller has to dispatch.
+    std::shared_ptr<Flight> lead(const K &key, std::shared_future<V> &future)
+    {
+        auto &shard = shardOf(key);
+        const auto now = Clock::now();
+        std::lock_guard<std::mutex> lk{shard.m};
+        sweep(shard, now);
+        const auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+            if (it->second.expires > now) {
+                future = it->second.future;
+                return nullptr;
+            }
+            shard.entries.erase(it);
+        }
+        auto flight = std::make_shared<Flight>(*this, key);
+        future = flight->future();
+        shard.entries.emplace(key, Entry{future, Clock::time_point::max()});
+        return flight;
+    }
+
+    void finish(const K &key, bool keep)
+    {
+        auto &shard = shardOf(key);
+        std::lock_guard<std::mutex> lk{shard.m};
+        const auto it = shard.entries.find(key);
+        if (it == shard.entries.end()) {
+            return;
+        }
+        if (keep && ttl_ > Clock::duration::zero()) {
+            it->second.expires = Clock::now() + ttl_;
+        } else {
+            shard.entries.erase(it);
+        }
+    }
+
+    // Removes expired results from `shard`, at most once per `ttl`.
+    void sweep(Shard &shard, typename Clock::time_point now)
+    {
+        if (ttl_ <= Clock::duration::zero() || now < shard.nextSweep) {
+            return;
+        }
+        for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+            if (it->second.expires <= now) {
+                it = shard.entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        shard.nextSweep = now + ttl_;
+    }
+
+    Shard & shardOf(const K &key)
+    {
+        return shards_[Hash{}(key) % numShards];
+    }
+
+    const typename Clock::duration ttl_;
+    std::array<Shard, numShards> shards_;
+};
+
+namespace detail {
+
+template <typename Pool, typename T, typename Body>
+class FeedTask;
+
+}
+
+// Lets the body of `parallelDo` add items as it goes. Items are kept by the
+// worker that added them, which processes them last in, first out; its
+// oldest items are handed to other workers only while fewer chunks of items
+// are in flight than the pool has workers.
+template <typename T>
+class Feeder final {
+public:
+    void add(const T &item)
+    {
+        items_->push_back(item);
+    }
+
+    void add(T &&item)
+    {
+        items_->push_back(std::move(item));
+    }
+
+private:
+    template <typename Pool, typename U, typename Body>
+    friend class detail::FeedTask;
+
+    explicit Feeder(std::vector<T> &items) : items_{&items}
+    {
+    }
+
+    std::vector<T> *items_;
+};
+
+namespace detail {
+
+// Shared by the tasks of a `parallelDo`.
+template <typename Body>
+struct FeedState {
+    explicit FeedState(const Body &body) : body(body)
+    {
+    }
+
+    const Body &body;
+    SyncState sync;
+    std::atomic<std::size_t> numChunks{0};
+    std::atomic<std::size_t> numActive{0};
+    std::atomic<bool> failed{false};
+};
+
+// The items of one chunk of a `parallelDo`. It counts as active until it
+// is freed, so that a chunk dropped without running, say by a shutdown,
+// does not keep the others from splitting.
+template <typename T, typename Body>
+struct FeedChunk {
+    template <typename Iter>
+    FeedChunk(FeedState<Body> &state, Iter first, Iter last)
+        : state(state), items(first, last)
+    {
+        state.numActive.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ~FeedChunk()
+    {
+        state.numActive.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    FeedChunk(const FeedChunk &other) = delete;
+    FeedChunk & operator=(const FeedChunk &other) = delete;
+
+    FeedState<Body> &state;
+    std::vector<T> items;
+};
+
+// Processes a chunk of items of a `parallelDo`, along with the items their
+// bodies add, and splits off half of what is left whenever other workers
+// may be out of work.
+template <typename Pool, typename T, typename Body>
+class FeedTask final {
+public:
+    FeedTask(Pool &pool, FeedState<Body> &state,
+            std::shared_ptr<FeedChunk<T, Body>> chunk)
+        : pool_{&pool}, state_{&state}, chunk_{std::move(chunk)}
+    {
+        state_->sync.hold();
+        state_->numChunks.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    FeedTask(const FeedTask &other)
+        : pool_{other.pool_}, state_{other.state_}, chunk_{other.chunk_}
+    {
+        state_->sync.hold();
+    }
+
+    FeedTask(FeedTask &&other)
+        : pool_{other.pool_},
+          state_{other.state_},
+          chunk_{std::move(other.chunk_)}
+    {
+        other.state_ = nullptr;
+    }
+
+    ~FeedTask()
+    {
+        if (state_) {
+            // The chunk must be gone before `parallelDo` may return.
+            chunk_.reset();
+            state_->sync.release();
+        }
+    }
+
+    FeedTask & operator=(const FeedTask &other) = delete;
+
+    void operator()() const
+    {
+        auto &items = chunk_->items;
+        state_->sync.run([this, &items] {
+            Feeder<T> feeder{items};
+            while (!items.empty() &&
+                    !state_->failed.load(std::memory_order_relaxed)) {
+                T item = std::move(items.back());
+                items.pop_back();
+                try {
+                    state_->body(item, feeder);
+                } catch (...) {
+                    state_->failed.store(true, std::memory_order_relaxed);
+                    throw;
+                }
+                if (items.size() >= 2 &&
+                        state_->numActive.load(std::memory_order_relaxed) <
+                        pool_->numThreads()) {
+                    split(items);
+                }
+            }
+        });
+    }
+
+private:
+    // Dispatches the older half of `items`, or keeps it if that fails.
+    void split(std::vector<T> &items) const
+    {
+        const auto half = static_cast<std::ptrdiff_t>(items.size() / 2);
+        auto chunk = std::make_shared<FeedChunk<T, Body>>(*state_,
+                std::make_move_iterator(items.begin()),
+                std::make_move_iterator(items.begin() + half));
+        items.erase(items.begin(), items.begin() + half);
+        try {
+            pool_->dispatch(FeedTask{*pool_, *state_, chunk});
+        } catch (...) {
+            state_->numChunks.fetch_sub(1, std::memory_order_relaxed);
+            items.insert(items.begin(),
+                    std::make_move_iterator(chunk->items.begin()),
+                    std::make_move_iterator(chunk->items.end()));
+        }
+    }
+
+    Pool *pool_;
+    FeedState<Body> *state_;
+    std::shared_ptr<FeedChunk<T, Body>> chunk_;
+};
+
+}
+
+template <typename Policy = DefaultTaskPoolPolicy>
+class BasicTaskPool final {
+public:
+    using TaskType = typename Policy::Task;
+
+    explicit BasicTaskPool(
+            std::size_t numThreads = defaultConcurrency().concurrency)
+        : BasicTaskPool{fixedSize(numThreads)}
+    {
+    }
+
+    explicit BasicTaskPool(const TaskPoolOptions &options)
+        : minThreads_{options.minThreads},
+          maxThreads_{options.maxThreads},
+          idleTimeout_{options.idleTimeout},
+          growthPolicy_{options.growthPolicy},
+          growthQueueDepth_{options.growthQueueDepth},
+          growthWaitTime_{options.growthWaitTime},
+          placement_{options.placement},
+          cpus_(options.cpus),
+          nodes_(placement_ == Placement::None
+                  ? std::vector<NumaNode>{{0, detail::allowedCpus(), {}}}
+                  : numaTopology()),
+          waitStrategy_{options.waitStrategy},
+          spinCount_{options.spinCount},
+          maxBatchSize_{std::max(options.maxBatchSize, std::size_t{1})},
+          stackPrefault_{options.stackPrefault},
+          trimIdleAfter_{options.trimIdleAfter},
+          capacity_{options.capacity},
+          rejectionPolicy_{options.rejectionPolicy},
+          room_{options.capacity},
+          saturationQueueDepth_{options.saturationQueueDepth},
+          sheddingTarget_{options.sheddingTarget},
+          sheddingInterval_{options.sheddingInterval},
+          onOverload_(options.onOverload)
+    {
+        checkConcurrency(minThreads_, maxThreads_);
+        if (placement_ == Placement::Explicit) {
+            checkCpus(cpus_);
+        }
+        if (!instrumented && (sheddingTarget_.count() > 0 ||
+                    growthPolicy_ == GrowthPolicy::WaitTime)) {
+            throw std::invalid_argument{
+                "option needs Instrumentation::Full"};
+        }
+        lastDequeue_ = std::chrono::steady_clock::now()
+            .time_since_epoch().count();
+
+        initNodes(options.initialQueueCapacity);
+
+        std::unique_lock<std::mutex> lk{workersMutex_};
+        try {
+            for (std::size_t i = 0; i < minThreads_; ++i) {
+                spawnWorker();
+            }
+        } catch (...) {
+            lk.unlock();
+            shutdown(ShutdownMode::Now);
+            throw;
+        }
+        lk.unlock();
+
+        if (options.warmup && minThreads_ > 0) {
+            try {
+                warmUp();
+            } catch (...) {
+                shutdown(ShutdownMode::Now);
+                throw;
+            }
+        }
+        trimmedBytes_ = queueBytes_.load();
+    }
+
+    ~BasicTaskPool()
+    {
+        shutdown(ShutdownMode::Drain);
+    }
+
+    // Stops accepting new tasks and stops the workers. With
+    // `ShutdownMode::Drain` every queued task is run first (tasks running on
+    // the pool may still dispatch follow-up work); with `ShutdownMode::Now`
+    // the workers only finish the tasks they are currently running. Returns
+    // the tasks that were never executed. Calling it again is a no-op.
+    std::vector<TaskType> shutdown(ShutdownMode mode = ShutdownMode::Drain)
+    {
+        return shutdown(mode, std::chrono::steady_clock::time_point::max());
+    }
+
+    std::vector<TaskType> shutdownNow()
+    {
+        return shutdown(ShutdownMode::Now);
+    }
+
+    // Whether a shutdown has begun, from which point on the pool refuses
+    // tasks from any thread but its own workers.
+    bool isShutDown() const
+    {
+        return state_.load() != State::Running;
+    }
+
+    // Drains the queue until `deadline`, then behaves like `shutdownNow`.
+    // Tasks already running when the deadline passes are not interrupted.
+    // Deadlines beyond what the steady clock can represent, such as
+    // `time_point::max()` of another clock, never pass.
+    template <typename Clock, typename Duration>
+    std::vector<TaskType> shutdown(
+            const std::chrono::time_point<Clock, Duration> &deadline)
+    {
+        using Steady = std::chrono::steady_clock;
+        using Seconds = std::chrono::duration<double>;
+
+        // In floating point, as neither the time left nor the room left on
+        // the steady clock may fit the other's integer duration; a second
+        // to spare absorbs the rounding.
+        const auto left = Seconds{deadline.time_since_epoch()} -
+            Seconds{Clock::now().time_since_epoch()};
+        const auto now = Steady::now();
+        const Seconds room = Steady::time_point::max() - now;
+        if (left.count() <= 0) {
+            return shutdown(ShutdownMode::Drain, now);
+        }
+        if (left >= room - Seconds{1}) {
+            return shutdown(ShutdownMode::Drain, Steady::time_point::max());
+        }
+        return shutdown(ShutdownMode::Drain,
+                now + std::chrono::duration_cast<Steady::duration>(left));
+    }
+
+    // Resizes the pool to exactly `numThreads` workers.
+    void setConcurrency(std::size_t numThreads)
+    {
+        setConcurrency(numThreads, numThreads);
+    }
+
+    // Changes the bounds within which the pool grows and shrinks. Surplus
+    // workers retire as soon as they are idle.
+    void setConcurrency(std::size_t minThreads, std::size_t maxThreads)
+    {
+        checkConcurrency(minThreads, maxThreads);
+
+        std::unique_lock<std::mutex> lk{workersMutex_};
+        if (state_ != State::Running) {
+            throw std::runtime_error{"task pool already shut down"};
+        }
+        minThreads_ = minThreads;
+        maxThreads_ = maxThreads;
+        reapWorkers();
+
+        const std::size_t numThreads = numThreads_;
+        if (numThreads < minThreads) {
+            for (auto i = numThreads; i < minThreads; ++i) {
+                spawnWorker();
+            }
+        } else if (numThreads > maxThreads) {
+            const auto numRetirees = numThreads - maxThreads;
+            numThreads_ -= numRetirees;
+            numRetirees_ += numRetirees;
+            events_.notifyAll();
+        }
+    }
+
+    // The NUMA nodes the pool's workers are placed on; `dispatchOnNode`
+    // takes an index into this. Without placement, all allowed CPUs make up
+    // a single node.
+    const std::vector<NumaNode> & nodes() const
+    {
+        return nodes_;
+    }
+
+    // The number of workers, not counting those about to retire.
+    std::size_t numThreads() const
+    {
+        return numThreads_;
+    }
+
+    TaskPoolStats stats() const
+    {
+        TaskPoolStats stats;
+        stats.numThreads = numThreads_;
+        stats.numIdle = numIdle_;
+        stats.numQueued = queuedApprox();
+        stats.numSleeps = events_.numSleeps();
+        stats.numWakes = events_.numWakes();
+        stats.numRejected = numRejected_;
+        stats.numDiscarded = numDiscarded_;
+        stats.numCallerRuns = numCallerRuns_;
+        stats.numSaturatedRuns = numSaturatedRuns_;
+        stats.overloaded = overloaded_;
+        stats.numShed = numShed_;
+        stats.queueBytesRetained = queueBytes_;
+        stats.queueBytesInUse = stats.numQueued * sizeof(Entry);
+        return stats;
+    }
+
+    // Dispatches tasks through a sub-queue of its own, which spares each
+    // dispatch the lookup of the calling thread's implicit sub-queue, and
+    // the pool from keeping such sub-queues around for short-lived threads.
+    // Tasks go to the node the submitter was created on. A submitter must
+    // only be used by one thread at a time, and not outlive its pool.
+    class Submitter final {
+    public:
+        void dispatch(const Task<void> &task)
+        {
+            pool_->checkArgs(task);
+
+            pool_->enqueue(node_, task, pool_->rejectionPolicy_,
+                    std::chrono::steady_clock::time_point::max(), &token_);
+        }
+
+        template <typename R>
+        std::future<R> dispatch(const Task<R> &task)
+        {
+            pool_->checkArgs(task);
+
+            auto p = pool_->template makePromise<R>();
+            pool_->enqueue(node_, fulfill(p, task), pool_->rejectionPolicy_,
+                    std::chrono::steady_clock::time_point::max(), &token_);
+            return p->get_future();
+        }
+
+        template <typename Iter>
+        void dispatch(Iter first, Iter last)
+        {
+            if (first >= last) {
+                return;
+            }
+            pool_->checkArgs(first, last);
+
+            pool_->enqueueBulk(node_, &token_, first, last);
+        }
+
+    private:
+        friend class BasicTaskPool;
+
+        Submitter(BasicTaskPool &pool, std::size_t node)
+            : pool_{&pool}, node_{node}, token_{pool.producerToken(node)}
+        {
+        }
+
+        BasicTaskPool *pool_;
+        std::size_t node_;
+        moodycamel::ProducerToken token_;
+    };
+
+    // A submitter for the calling thread's node.
+    Submitter submitter()
+    {
+        return Submitter{*this, homeNode()};
+    }
+
+    // Gives the queue blocks that no task uses any more back to the
+    // allocator, and returns how many bytes that freed. This blocks
+    // dispatchers: the queue cannot free blocks while tasks are enqueued,
+    // so new dispatches spin until it is done, and it first waits up to a
+    // millisecond for those already under way. If they do not finish by
+    // then, for example because they wait for room, it gives up and returns
+    // 0. Blocks taken by a `Submitter` are only freed along with the pool.
+    std::size_t trimMemory()
+    {
+        if (trimming_.exchange(true)) {
+            return 0;
+        }
+        const auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::milliseconds{1};
+        while (!inFlight_.isZero()) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                trimming_ = false;
+                return 0;
+            }
+            std::this_thread::yield();
+        }
+
+        const std::size_t before = queueBytes_;
+        for (auto &q: queues_) {
+            q.trim_free_blocks();
+        }
+        const std::size_t after = queueBytes_;
+        trimmedBytes_ = after;
+        trimming_ = false;
+        return before > after ? before - after : 0;
+    }
+
+    BasicTaskPool(const BasicTaskPool &other) = delete;
+    BasicTaskPool(BasicTaskPool &&other) = delete;
+    BasicTaskPool & operator=(const BasicTaskPool &other) = delete;
+    BasicTaskPool & operator=(BasicTaskPool &&other) = delete;
+
+    void dispatch(const Task<void> &task)
+    {
+        checkArgs(task);
+
+        enqueue(task);
+    }
+
+    template <typename R>
+    std::future<R> dispatch(const Task<R> &task)
+    {
+        checkArgs(task);
+
+        auto p = makePromise<R>();
+        enqueue(homeNode(), fulfill(p, task));
+        return p->get_future();
+    }
+
+    // Like `dispatch`, but queues the task on NUMA node `node` (an index into
+    // `nodes()`), so that it runs on one of that node's workers unless they
+    // are all busy and a worker of another node steals it.
+    void dispatchOnNode(std::size_t node, const Task<void> &task)
+    {
+        checkArgs(task);
+        checkNode(node);
+
+        enqueue(node, task);
+    }
+
+    template <typename R>
+    std::future<R> dispatchOnNode(std::size_t node, const Task<R> &task)
+    {
+        checkArgs(task);
+        checkNode(node);
+
+        auto p = makePromise<R>();
+        enqueue(node, fulfill(p, task));
+        return p->get_future();
+    }
+
+    // Whether every worker is busy, the pool is as large as it may grow, and
+    // the queue is longer than `TaskPoolOptions::saturationQueueDepth`.
+    bool saturated() const
+    {
+        return numIdle_.load(std::memory_order_relaxed) == 0 &&
+            numThreads_.load(std::memory_order_relaxed) >= maxThreads_ &&
+            queuedApprox() > saturationQueueDepth_;
+    }
+
+    // Like `dispatch`, but runs the task on the calling thread right away
+    // if the pool is saturated, as queuing would only add to its latency.
+    // Returns whether the task ran on the calling thread. Throws like
+    // `dispatch` once the pool is shut down, saturated or not.
+    bool dispatchOrRun(const Task<void> &task)
+    {
+        checkArgs(task);
+
+        if (saturated()) {
+            checkRunning();
+            count(numCallerRuns_);
+            count(numSaturatedRuns_);
+            task();
+            return true;
+        }
+        enqueue(task);
+        return false;
+    }
+
+    // The future is ready on return if the task ran on the calling thread.
+    template <typename R>
+    std::future<R> dispatchOrRun(const Task<R> &task)
+    {
+        checkArgs(task);
+
+        auto p = makePromise<R>();
+        if (saturated()) {
+            checkRunning();
+            count(numCallerRuns_);
+            count(numSaturatedRuns_);
+            fulfill(p, task)();
+        } else {
+            enqueue(homeNode(), fulfill(p, task));
+        }
+        return p->get_future();
+    }
+
+    // Like `dispatch`, but sheds `Priority::Low` tasks while the pool is
+    // overloaded (see `TaskPoolOptions::sheddingTarget`), returning false
+    // or an invalid future.
+    bool dispatch(Priority priority, const Task<void> &task)
+    {
+        checkArgs(task);
+
+        if (shed(priority)) {
+            return false;
+        }
+        enqueue(task);
+        return true;
+    }
+
+    template <typename R>
+    std::future<R> dispatch(Priority priority, const Task<R> &task)
+    {
+        checkArgs(task);
+
+        if (shed(priority)) {
+            return {};
+        }
+        auto p = makePromise<R>();
+        enqueue(homeNode(), fulfill(p, task));
+        return p->get_future();
+    }
+
+    // Like `dispatch`, but if the queue is full, returns false (or an
+    // invalid future) instead of applying the rejection policy.
+    bool tryDispatch(const Task<void> &task)
+    {
+        checkArgs(task);
+
+        return enqueue(homeNode(), task, RejectionPolicy::Block,
+                std::chrono::steady_clock::time_point::min());
+    }
+
+    template <typename R>
+    std::future<R> tryDispatch(const Task<R> &task)
+    {
+        checkArgs(task);
+
+        auto p = makePromise<R>();
+        if (!enqueue(homeNode(), fulfill(p, task), RejectionPolicy::Block,
+                    std::chrono::steady_clock::time_point::min())) {
+            return {};
+        }
+        return p->get_future();
+    }
+
+    // Like `tryDispatch`, but waits up to `timeout` for room in the queue.
+    template <typename Rep, typename Period>
+    bool dispatchFor(
+            const std::chrono::duration<Rep, Period> &timeout,
+            const Task<void> &task)
+    {
+        checkArgs(task);
+
+        return enqueue(homeNode(), task, RejectionPolicy::Block,
+                deadlineAfter(timeout));
+    }
+
+    template <typename R, typename Rep, typename Period>
+    std::future<R> dispatchFor(
+            const std::chrono::duration<Rep, Period> &timeout,
+            const Task<R> &task)
+    {
+        checkArgs(task);
+
+        auto p = makePromise<R>();
+        if (!enqueue(homeNode(), fulfill(p, task), RejectionPolicy::Block,
+                    deadlineAfter(timeout))) {
+            return {};
+        }
+        return p->get_future();
+    }
+
+    template <typename Iter>
+    void dispatch(Iter first, Iter last)
+    {
+        if (first >= last) {
+            return;
+        }
+        checkArgs(first, last);
+
+        enqueueBulk(homeNode(), nullptr, first, last);
+    }
+
+    template <typename R, typename Iter>
+    std::vector<std::future<R>> dispatch(Iter first, Iter last)
+    {
+        if (first >= last) {
+            return {};
+        }
+        checkArgs(first, last);
+
+        std::vector<std::future<R>> futures;
+        futures.reserve(last - first);
+        for (auto it = first; it != last; ++it) {
+            futures.emplace_back(dispatch<R>(*it));
+        }
+        return futures;
+    }
+
+    // Rethrows the first exception a task threw, or throws a broken
+    // promise if a task was dropped without running; either only once no
+    // task is left.
+    template <typename Iter>
+    void dispatchSync(Iter first, Iter last)
+    {
+        syncDispatch<void>(first, last, detail::NoOutput{});
+    }
+
+    template <typename R, typename Iter>
+    std::vector<R> dispatchSync(Iter first, Iter last)
+    {
+        if (first >= last) {
+            return {};
+        }
+        checkArgs(first, last);
+
+        std::vector<std::future<R>> futures;
+        futures.reserve(last - first);
+
+        for (auto it = first; it != last; ++it) {
+            futures.emplace_back(dispatch<R>(std::bind([&](decltype(*it) t) {
+                return t();
+            }, *it)));
+        }
+
+        std::vector<R> results;
+        results.reserve(last - first);
+
+        for (auto &f: futures) {
+            results.emplace_back(f.get());
+        }
+        return results;
+    }
+
+    // Like `dispatchSync<R>`, but assigns each result to its place in
+    // `out`, a random-access iterator to at least `last - first` elements,
+    // so that it is moved there once and may be move-only. Rethrows the
+    // first exception a task threw, or throws a broken promise if a task
+    // was dropped without running; either only once no task is left.
+    template <typename R, typename Iter, typename Out>
+    void dispatchSync(Iter first, Iter last, Out out)
+    {
+        syncDispatch<R>(first, last, out);
+    }
+
+    // Calls `body(item, feeder)` for every item in [first, last) and every
+    // item the calls add to `feeder`, a `Feeder<T>` for the value type `T`
+    // of `Iter`, and waits for all of them. Once a call throws, the items
+    // not yet processed are skipped, and the first exception is rethrown.
+    template <typename Iter, typename Body>
+    void parallelDo(Iter first, Iter last, const Body &body)
+    {
+        using T = typename std::iterator_traits<Iter>::value_type;
+        using Chunk = detail::FeedChunk<T, Body>;
+
+        std::vector<T> items(first, last);
+        if (items.empty()) {
+            return;
+        }
+        const auto numChunks = std::min(items.size(),
+                std::max(numThreads(), std::size_t{1}));
+
+        detail::FeedState<Body> state{body};
+        std::exception_ptr error;
+        try {
+            for (std::size_t i = 0; i < numChunks; ++i) {
+                const auto begin = items.begin() + static_cast<std::ptrdiff_t>(
+                        i * items.size() / numChunks);
+                const auto end = items.begin() + static_cast<std::ptrdiff_t>(
+                        (i + 1) * items.size() / numChunks);
+                dispatch(detail::FeedTask<BasicTaskPool, T, Body>{*this,
+                        state, std::make_shared<Chunk>(state,
+                                std::make_move_iterator(begin),
+                                std::make_move_iterator(end))});
+            }
+        } catch (...) {
+            state.failed.store(true, std::memory_order_relaxed);
+            error = std::current_exception();
+        }
+
+        state.sync.wait();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        state.sync.check(state.numChunks.load(std::memory_order_relaxed));
+    }
+
+    // Applies `fn` to every input in [first, last), which may be a single
+    // pass, and passes the results to `sink` on the calling thread, with at
+    // most `maxInFlight` inputs read but not yet passed on at any time.
+    // Inputs are read only as slots free up. If `fn` returns void, `sink`
+    // is called without arguments as each input is done. Once `fn` or
+    // `sink` throws, no more inputs are read, and the first exception is
+    // rethrown after the inputs in flight are done.
+    template <typename Iter, typename F, typename Sink>
+    void mapBounded(Iter first, Iter last, std::size_t maxInFlight,
+            const F &fn, const Sink &sink,
+            MapOrder order = MapOrder::Completion)
+    {
+        using T = typename std::iterator_traits<Iter>::value_type;
+        using R = typename std::decay<
+            typename std::result_of<const F &(T &&)>::type>::type;
+
+        if (maxInFlight == 0) {
+            throw std::invalid_argument{"invalid number of inputs in flight"};
+        }
+
+        detail::MapState<T, R> state{maxInFlight, allocator_};
+        std::vector<std::size_t> free;
+        std::vector<std::size_t> ready;
+        std::vector<std::size_t> bySeq(maxInFlight);
+        std::vector<bool> done(maxInFlight);
+        for (std::size_t i = maxInFlight; i > 0; --i) {
+            free.push_back(i - 1);
+        }
+        ready.reserve(maxInFlight);
+
+        std::exception_ptr error;
+        std::size_t inFlight = 0;
+        std::size_t nextSeq = 0;
+        std::size_t nextOut = 0;
+
+        const auto deliver = [&](std::size_t i) {
+            auto &slot = state.slot(i);
+            if (!error) {
+                if (slot.output.error()) {
+                    error = slot.output.error();
+                } else {
+                    try {
+                        detail::sinkResult(sink, slot.output);
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                }
+            }
+            slot.input.reset();
+            slot.output.reset();
+            slot.ran = false;
+            done[i] = false;
+            free.push_back(i);
+            --inFlight;
+        };
+
+        for (;;) {
+            while (!error && first != last && inFlight < maxInFlight) {
+                const auto i = free.back();
+                auto &slot = state.slot(i);
+                slot.input.run([&first] { return T(*first); });
+                ++first;
+                if (slot.input.error()) {
+                    error = slot.input.error();
+                    slot.input.reset();
+                    break;
+                }
+                free.pop_back();
+                bySeq[nextSeq++ % maxInFlight] = i;
+                ++inFlight;
+                try {
+                    dispatch(detail::MapTask<T, R, F>{state, i, fn});
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+            if (inFlight == 0) {
+                break;
+            }
+
+            ready.clear();
+            state.take(ready);
+            for (const auto i: ready) {
+                if (order == MapOrder::Completion) {
+                    deliver(i);
+                } else {
+                    done[i] = true;
+                }
+            }
+            while (order == MapOrder::Input && inFlight > 0 &&
+                    done[bySeq[nextOut % maxInFlight]]) {
+                deliver(bySeq[nextOut++ % maxInFlight]);
+            }
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    template <typename Iter>
+    void dispatchSerial(Iter first, Iter last)
+    {
+        if (first >= last) {
+            return;
+        }
+        checkArgs(first, last);
+
+        using Tasks = std::vector<Task<void>, Rebind<Task<void>>>;
+        auto tasks = std::allocate_shared<Tasks>(allocator_, first, last,
+                Rebind<Task<void>>{allocator_});
+        dispatch([tasks] {
+            for (const auto &t: *tasks) {
+                t();
+            }
+        });
+    }
+
+    template <typename R, typename Iter>
+    std::vector<std::future<R>> dispatchSerial(Iter first, Iter last)
+    {
+        if (first >= last) {
+            return {};
+        }
+        checkArgs(first, last);
+
+        using Promises = std::vector<std::promise<R>, Rebind<std::promise<R>>>;
+        auto promises = std::allocate_shared<Promises>(allocator_,
+                Rebind<std::promise<R>>{allocator_});
+        promises->reserve(last - first);
+        std::vector<std::future<R>> futures;
+        futures.reserve(last - first);
+        for (auto it = first; it != last; ++it) {
+            promises->emplace_back(std::allocator_arg, allocator_);
+            futures.emplace_back(promises->back().get_future());
+        }
+
+        using Tasks = std::vector<Task<R>, Rebind<Task<R>>>;
+        auto tasks = std::allocate_shared<Tasks>(allocator_, first, last,
+                Rebind<Task<R>>{allocator_});
+        dispatch([tasks, promises] {
+            for (std::size_t i = 0; i < tasks->size(); ++i) {
+                try {
+                    (*promises)[i].set_value((*tasks)[i]());
+                } catch (...) {
+                    (*promises)[i].set_exception(std::current_exception());
+                }
+            }
+        });
+        return futures;
+    }
+
+    // Runs the callables in parallel, fork-join style, and returns their
+    // results. All but the first are queued; the calling thread runs the
+    // first, then any the workers have not started yet, then waits for the
+    // rest. If any callable threw, rethrows the exception of the first one
+    // that did, once all are done. Callables that return void have a
+    // `NoResult` in their place.
+    template <typename... F>
+    typename detail::InvokeState<F...>::Results invokeAll(const F &... fs)
+    {
+        using State = detail::InvokeState<F...>;
+        auto state = std::allocate_shared<State>(allocator_, fs...);
+        fork(state, typename detail::MakeIndexSequence<sizeof...(F)>::type{});
+        return state->join();
+    }
+
+    // Like `dispatch<R>(first, last)`, but queues each result in
+    // `completions` as soon as it is ready, under the index of its task in
+    // the batch. Tasks that are dropped, including those of a batch that
+    // could not be queued, come out with a broken promise. `completions`
+    // must outlive the tasks.
+    template <typename R, typename Iter>
+    void dispatch(Iter first, Iter last, CompletionQueue<R> &completions)
+    {
+        if (first >= last) {
+            return;
+        }
+        checkArgs(first, last);
+
+        const auto n = static_cast<std::size_t>(last - first);
+        auto batch = std::allocate_shared<detail::CompletionBatch<R>>(
+                allocator_, completions, n, allocator_);
+        std::vector<TaskType, Rebind<TaskType>> tasks(allocator_);
+        tasks.reserve(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            tasks.emplace_back(detail::CompletionTask<R>{batch, i, first[i]});
+        }
+        enqueueBulk(homeNode(), nullptr,
+                std::make_move_iterator(tasks.begin()),
+                std::make_move_iterator(tasks.end()));
+    }
+
+    // Like `dispatch<R>(first, last)`, but with all results in a single
+    // `BulkFuture`, which spares a promise and shared state per task.
+    template <typename R, typename Iter>
+    BulkFuture<R> dispatchBulk(Iter first, Iter last)
+    {
+        if (first >= last) {
+            return BulkFuture<R>{
+                std::allocate_shared<detail::BulkState<R>>(allocator_, 0,
+                        allocator_)};
+        }
+        checkArgs(first, last);
+
+        const auto n = static_cast<std::size_t>(last - first);
+        auto state = std::allocate_shared<detail::BulkState<R>>(allocator_, n,
+                allocator_);
+        std::vector<TaskType, Rebind<TaskType>> tasks(allocator_);
+        tasks.reserve(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            tasks.emplace_back(detail::BulkTask<R>{state, i, first[i]});
+        }
+        enqueueBulk(homeNode(), nullptr,
+                std::make_move_iterator(tasks.begin()),
+                std::make_move_iterator(tasks.end()));
+        return BulkFuture<R>{std::move(state)};
+    }
+
+    // Like `dispatchSerial<R>`, but with all results in a single
+    // `BulkFuture`.
+    template <typename R, typename Iter>
+    BulkFuture<R> dispatchSerialBulk(Iter first, Iter last)
+    {
+        if (first >= last) {
+            return BulkFuture<R>{
+                std::allocate_shared<detail::BulkState<R>>(allocator_, 0,
+                        allocator_)};
+        }
+        checkArgs(first, last);
+
+        const auto n = static_cast<std::size_t>(last - first);
+        auto state = std::allocate_shared<detail::BulkState<R>>(allocator_, n,
+                allocator_);
+        using Tasks = std::vector<Task<R>, Rebind<Task<R>>>;
+        std::shared_ptr<const Tasks> tasks = std::allocate_shared<Tasks>(
+                allocator_, first, last, Rebind<Task<R>>{allocator_});
+        dispatch(detail::SerialBulkTask<R, Tasks>{state, std::move(tasks)});
+        return BulkFuture<R>{std::move(state)};
+    }
+
+    void dispatchOnce(std::once_flag &flag, const Task<void> &task)
+    {
+        dispatch([task, &flag] {
+            std::call_once(flag, task);
+        });
+    }
+
+    // Dispatches `task` unless `flag` has been dispatched to before. Only
+    // the first call enqueues anything; later ones return after checking
+    // the flag.
+    void dispatchOnce(OnceFlag &flag, const Task<void> &task)
+    {
+        if (flag.claim()) {
+            dispatch(OnceFlag::Runner{flag, task});
+        }
+    }
+
+    // Dispatches `loader` for `key` unless a load of that key is in flight
+    // in `group`, or its result is still kept there, and returns the future
+    // that every caller for the key shares.
+    template <typename K, typename V, typename H, typename C, typename F>
+    std::shared_future<V> singleFlight(SingleFlight<K, V, H, C> &group,
+            const K &key, const F &loader)
+    {
+        std::shared_future<V> future;
+        auto flight = group.lead(key, future);
+        if (flight) {
+            dispatch(typename SingleFlight<K, V, H, C>::Runner{
+                    std::move(flight), Task<V>{loader}});
+        }
+        return future;
+    }
+
+private:
+    enum class State {
+        Running,
+        Draining,
+        Stopping,
+        Terminated
+    };
+
+    // The `dispatchSync` overloads that wait on a single latch.
+    template <typename R, typename Iter, typename Out>
+    void syncDispatch(Iter first, Iter last, Out out)
+    {
+        if (first >= last) {
+            return;
+        }
+        checkArgs(first, last);
+
+        const auto n = static_cast<std::size_t>(last - first);
+        detail::SyncState state;
+        std::exception_ptr error;
+        {
+            std::vector<TaskType, Rebind<TaskType>> tasks(allocator_);
+            try {
+                tasks.reserve(n);
+                for (std::size_t i = 0; i < n; ++i) {
+                    tasks.emplace_back(
+                            detail::SyncTask<R, Out>{state, out + i, first[i]});
+                }
+                enqueueBulk(homeNode(), nullptr,
+                        std::make_move_iterator(tasks.begin()),
+                        std::make_move_iterator(tasks.end()));
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+
+        // The tasks refer to `state`, so they must be gone even if not all
+        // of them made it into the queue.
+        state.wait();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        state.check(n);
+    }
+
+    // Registers the calling thread as in the middle of a dispatch, so that
+    // shutdown can wait for in-flight dispatches before sweeping the queue.
+    // Once shutdown has begun, only the pool's own workers may dispatch, and
+    // only while draining.
+    class DispatchGuard final {
+    public:
+        explicit DispatchGuard(BasicTaskPool &pool)
+            : pool_(pool), shard_{detail::threadShard()},
+              allocations_{pool.queueBytes_}
+        {
+            for (;;) {
+                pool_.inFlight_.add(shard_, 1);
+
+                const auto state = pool_.state_.load();
+                if (state != State::Running && !(state == State::Draining &&
+                            currentPool() == &pool_)) {
+                    pool_.inFlight_.add(shard_, -1);
+                    throw std::runtime_error{"task pool already shut down"};
+                }
+                if (!pool_.trimming_.load()) {
+                    return;
+                }
+
+                // Queue blocks are being freed, which dispatches must not
+                // race with.
+                pool_.inFlight_.add(shard_, -1);
+                while (pool_.trimming_.load(std::memory_order_relaxed)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        ~DispatchGuard()
+        {
+            pool_.inFlight_.add(shard_, -1);
+        }
+
+        DispatchGuard(const DispatchGuard &other) = delete;
+        DispatchGuard & operator=(const DispatchGuard &other) = delete;
+
+    private:
+        BasicTaskPool &pool_;
+        const std::size_t shard_;
+        detail::CountedAllocations allocations_;
+    };
+
+    // The CPUs of `Placement::Explicit` must be ones the process may run on,
+    // as pinning a worker to any other would fail or be undefined.
+    static void checkCpus(const std::vector<int> &cpus)
+    {
+        if (cpus.empty()) {
+            throw std::invalid_argument{"no CPUs to place workers on"};
+        }
+        const auto allowed = detail::allowedCpus();
+        for (const auto cpu: cpus) {
+            if (std::find(allowed.begin(), allowed.end(), cpu) ==
+                    allowed.end()) {
+                throw std::invalid_argument{"CPU " + std::to_string(cpu) +
+                    " is not in the process's affinity mask"};
+            }
+        }
+    }
+
+    // Throws as a dispatch would if the pool no longer takes tasks, for
+    // tasks about to run on the calling thread instead.
+    void checkRunning()
+    {
+        const DispatchGuard guard{*this};
+    }
+
+    static constexpr bool instrumented =
+        Policy::instrumentation == Instrumentation::Full;
+
+    using Entry = detail::QueueEntry<TaskType, instrumented>;
+
+    // Queues all but the first callable of `invokeAll`.
+    template <typename State, std::size_t First, std::size_t... Rest>
+    void fork(const std::shared_ptr<State> &state,
+            detail::IndexSequence<First, Rest...>)
+    {
+        TaskType tasks[] = {
+            TaskType{detail::InvokeTask<State, Rest>{state}}...
+        };
+        enqueueBulk(homeNode(), nullptr,
+                std::make_move_iterator(std::begin(tasks)),
+                std::make_move_iterator(std::end(tasks)));
+    }
+
+    template <typename State, std::size_t First>
+    void fork(const std::shared_ptr<State> &, detail::IndexSequence<First>)
+    {
+    }
+
+    template <typename T>
+    using Rebind = typename std::allocator_traits<
+        typename Policy::Allocator>::template rebind_alloc<T>;
+
+    // A promise that, along with its shared state, comes from the policy's
+    // allocator.
+    template <typename R>
+    std::shared_ptr<std::promise<R>> makePromise()
+    {
+        return std::allocate_shared<std::promise<R>>(allocator_,
+                std::allocator_arg, allocator_);
+    }
+
+    // Turns tasks into entries on the fly, for bulk enqueueing.
+    template <typename Iter>
+    class Stamped final {
+    public:
+        Stamped(Iter it, std::chrono::steady_clock::rep enqueued)
+            : it_(it), enqueued_{enqueued}
+        {
+        }
+
+        Entry operator*() const
+        {
+            return {*it_, enqueued_};
+        }
+
+        Stamped & operator++()
+        {
+            ++it_;
+            return *this;
+        }
+
+        Stamped operator++(int)
+        {
+            auto old = *this;
+            ++it_;
+            return old;
+        }
+
+    private:
+        Iter it_;
+        std::chrono::steady_clock::rep enqueued_;
+    };
+
+    using Queue = typename Policy::template Queue<Entry>;
+    using ConsumerTokens = std::vector<moodycamel::ConsumerToken>;
+
+    static const BasicTaskPool *& currentPool()
+    {
+        static thread_local const BasicTaskPool *pool = nullptr;
+        return pool;
+    }
+
+    // The node of the calling worker, valid while `currentPool()` is set.
+    static std::size_t & currentNode()
+    {
+        static thread_local std::size_t node = 0;
+        return node;
+    }
+
+    struct Worker {
+        std::thread thread;
+        bool retired = false;
+        std::size_t slot;
+        std::size_t node;
+        std::vector<int> cpus;  // empty if not pinned
+    };
+
+    template <typename R>
+    static TaskType fulfill(
+            const std::shared_ptr<std::promise<R>> &p,
+            const Task<R> &task)
+    {
+        return [p, task] {
+            try {
+                p->set_value(task());
+            } catch (...) {
+                p->set_exception(std::current_exception());
+            }
+        };
+    }
+
+    // Sets up one queue per node, and the order in which each node's
+    // workers look through them: their own node first, then the others by
+    // increasing distance.
+    void initNodes(std::size_t queueCapacity)
+    {
+        detail::CountedAllocations allocations{queueBytes_};
+        const auto numNodes = nodes_.size();
+        queues_.reserve(numNodes);
+        stealOrder_.resize(numNodes);
+
+        for (std::size_t i = 0; i < numNodes; ++i) {
+            if (queueCapacity > 0) {
+                queues_.emplace_back(queueCapacity);
+            } else {
+                queues_.emplace_back();
+            }
+
+            for (auto cpu: nodes_[i].cpus) {
+                const auto c = static_cast<std::size_t>(cpu);
+                if (c >= cpuNodes_.size()) {
+                    cpuNodes_.resize(c + 1, 0);
+                }
+                cpuNodes_[c] = i;
+                compactCpus_.emplace_back(cpu);
+            }
+
+            const auto &distances = nodes_[i].distances;
+            const auto distance = [&](std::size_t j) {
+                return i == j ? -1
+                    : nodes_[j].id < distances.size()
+                    ? distances[nodes_[j].id]
+                    : 0;
+            };
+            auto &order = stealOrder_[i];
+            for (std::size_t j = 0; j < numNodes; ++j) {
+                order.emplace_back(j);
+            }
+            std::stable_sort(order.begin(), order.end(),
+                    [&](std::size_t a, std::size_t b) {
+                        return distance(a) < distance(b);
+                    });
+        }
+    }
+
+    moodycamel::ProducerToken producerToken(std::size_t node)
+    {
+        detail::CountedAllocations allocations{queueBytes_};
+        return moodycamel::ProducerToken{queues_[node]};
+    }
+
+    std::size_t nodeOfCpu(int cpu) const
+    {
+        const auto c = static_cast<std::size_t>(cpu);
+        return cpu >= 0 && c < cpuNodes_.size() ? cpuNodes_[c] : 0;
+    }
+
+    // The node whose queue a plain dispatch goes to: the worker's own node,
+    // or the node of the CPU the dispatching thread is running on.
+    std::size_t homeNode() const
+    {
+        if (queues_.size() == 1) {
+            return 0;
+        }
+        if (currentPool() == this) {
+            return currentNode();
+        }
+        return nodeOfCpu(detail::currentCpu());
+    }
+
+    void checkNode(std::size_t node) const
+    {
+        if (node >= nodes_.size()) {
+            throw std::out_of_range{"no such NUMA node"};
+        }
+    }
+
+    // Must be called with `workersMutex_` held.
+    void place(Worker &w) const
+    {
+        const auto slot = w.slot;
+        const auto numNodes = nodes_.size();
+
+        switch (placement_) {
+        case Placement::None:
+            w.node = 0;
+            break;
+        case Placement::Compact:
+            w.cpus = {compactCpus_[slot % compactCpus_.size()]};
+            w.node = nodeOfCpu(w.cpus.front());
+            break;
+        case Placement::Scatter: {
+            w.node = slot % numNodes;
+            const auto &cpus = nodes_[w.node].cpus;
+            w.cpus = {cpus[slot / numNodes % cpus.size()]};
+            break;
+        }
+        case Placement::Explicit:
+            w.cpus = {cpus_[slot % cpus_.size()]};
+            w.node = nodeOfCpu(w.cpus.front());
+            break;
+        case Placement::PerNode:
+            w.node = slot % numNodes;
+            w.cpus = nodes_[w.node].cpus;
+            break;
+        }
+    }
+
+    // Must be called with `workersMutex_` held.
+    void releaseSlot(Worker &w)
+    {
+        w.retired = true;
+        slots_[w.slot] = false;
+    }
+
+    std::size_t queuedApprox() const
+    {
+        std::size_t n = 0;
+        for (const auto &q: queues_) {
+            n += q.size_approx();
+        }
+        return n;
+    }
+
+    // Takes up to `max` tasks from the first non-empty queue, and returns
+    // how many it took.
+    std::size_t tryDequeue(
+            ConsumerTokens &ctoks,
+            std::size_t node,
+            std::vector<Entry> &batch,
+            std::size_t max)
+    {
+        for (auto q: stealOrder_[node]) {
+            const auto n = queues_[q].try_dequeue_bulk(ctoks[q],
+                    batch.begin(), max);
+            if (n > 0) {
+                return n;
+            }
+        }
+        return 0;
+    }
+
+    // Caps a worker's batch at its share of the queue while other workers
+    // are idle, so that it does not sit on tasks they could be running.
+    std::size_t fairBatchSize(std::size_t batchSize) const
+    {
+        if (batchSize == 1 || numIdle_.load(std::memory_order_relaxed) == 0) {
+            return batchSize;
+        }
+        const auto share = queuedApprox() / (numThreads_ + 1) + 1;
+        return std::min(batchSize, share);
+    }
+
+    static TaskPoolOptions fixedSize(std::size_t numThreads)
+    {
+        TaskPoolOptions options;
+        options.minThreads = numThreads;
+        options.maxThreads = numThreads;
+        return options;
+    }
+
+    static void checkConcurrency(std::size_t minThreads, std::size_t maxThreads)
+    {
+        if (maxThreads == 0 || minThreads > maxThreads) {
+            throw std::invalid_argument{"invalid number of threads"};
+        }
+    }
+
+    template <typename T>
+    void enqueue(T &&task)
+    {
+        enqueue(homeNode(), std::forward<T>(task));
+    }
+
+    template <typename T>
+    void enqueue(std::size_t node, T &&task)
+    {
+        enqueue(node, std::forward<T>(task), rejectionPolicy_,
+                std::chrono::steady_clock::time_point::max());
+    }
+
+    // Returns false if `task` was neither queued nor run, which only
+    // happens if there was no room for it before `deadline`. Goes through
+    // the implicit sub-queue of the calling thread unless given a token
+    // that got a sub-queue of its own.
+    template <typename T>
+    bool enqueue(
+            std::size_t node,
+            T &&task,
+            RejectionPolicy policy,
+            std::chrono::steady_clock::time_point deadline,
+            moodycamel::ProducerToken *token = nullptr)
+    {
+        {
+            DispatchGuard guard{*this};
+            if (capacity_ == 0 || makeRoom(node, policy, deadline)) {
+                Entry e{std::forward<T>(task), stamp()};
+                if (token && token->valid()) {
+                    queues_[node].enqueue(*token, std::move(e));
+                } else {
+                    queues_[node].enqueue(std::move(e));
+                }
+                events_.notify();
+                maybeGrow();
+                return true;
+            }
+        }
+        if (policy != RejectionPolicy::CallerRuns) {
+            return false;
+        }
+
+        // Run the task without holding up a shutdown or `trimMemory` for
+        // as long as it takes, but refuse it like a dispatch if a shutdown
+        // began while making room.
+        checkRunning();
+        count(numCallerRuns_);
+        task();
+        return true;
+    }
+
+    template <typename Iter>
+    void enqueueBulk(
+            std::size_t node,
+            moodycamel::ProducerToken *token,
+            Iter first,
+            Iter last)
+    {
+        const auto shard = detail::threadShard();
+        for (auto it = first; it != last; ) {
+            // Queue as many tasks at once as there is room for; once there
+            // is none, the rejection policy decides about the next task,
+            // outside the guard in case that task runs on this thread.
+            {
+                DispatchGuard guard{*this};
+                auto n = static_cast<std::size_t>(last - it);
+                if (capacity_ > 0) {
+                    n = room_.acquire(shard, n);
+                }
+                if (n > 0) {
+                    const Stamped<Iter> entries{it, stamp()};
+                    if (token && token->valid()) {
+                        queues_[node].enqueue_bulk(*token, entries, n);
+                    } else {
+                        queues_[node].enqueue_bulk(entries, n);
+                    }
+                    events_.notify(n);
+                    maybeGrow();
+                    it += n;
+                    continue;
+                }
+            }
+            enqueue(node, *it++, rejectionPolicy_,
+                    std::chrono::steady_clock::time_point::max(), token);
+        }
+    }
+
+    // Takes a slot in the queue for one more task, applying `policy` if
+    // there is none. Returns false if the task must not be queued.
+    bool makeRoom(
+            std::size_t node,
+            RejectionPolicy policy,
+            std::chrono::steady_clock::time_point deadline)
+    {
+        const auto shard = detail::threadShard();
+        if (room_.acquire(shard, 1) == 1) {
+            return true;
+        }
+
+        switch (policy) {
+        case RejectionPolicy::Block:
+            // Workers waiting for each other to make room could wait
+            // forever, so they exceed the capacity instead.
+            if (currentPool() == this &&
+                    deadline == std::chrono::steady_clock::time_point::max()) {
+                room_.overdraw(shard, 1);
+                return true;
+            }
+            if (waitForRoom(shard, deadline)) {
+                return true;
+            }
+            count(numRejected_);
+            return false;
+        case RejectionPolicy::CallerRuns:
+            return false;
+        case RejectionPolicy::DiscardOldest:
+            discardOldest(node, shard);
+            return true;
+        case RejectionPolicy::Throw:
+            break;
+        }
+        count(numRejected_);
+        throw std::overflow_error{"task pool is full"};
+    }
+
+    bool waitForRoom(
+            std::size_t shard,
+            std::chrono::steady_clock::time_point deadline)
+    {
+        for (;;) {
+            const auto key = roomFreed_.prepareWait();
+            if (room_.acquire(shard, 1) == 1) {
+                roomFreed_.cancelWait();
+                return true;
+            }
+            if (stopRequested()) {
+                roomFreed_.cancelWait();
+                throw std::runtime_error{"task pool already shut down"};
+            }
+            if (std::chrono::steady_clock::now() >= deadline) {
+                roomFreed_.cancelWait();
+                return false;
+            }
+
+            // Workers stop making room once a shutdown deadline passes.
+            roomFreed_.commitWait(key, state_ == State::Running
+                    ? deadline
+                    : std::min(deadline, deadline_));
+        }
+    }
+
+    // Drops the oldest task of the first non-empty queue, nearest first,
+    // and takes over its slot.
+    void discardOldest(std::size_t node, std::size_t shard)
+    {
+        Entry e;
+        for (;;) {
+            for (auto q: stealOrder_[node]) {
+                if (queues_[q].try_dequeue(e)) {
+                    count(numDiscarded_);
+                    return;
+                }
+            }
+            // The queue may look empty while dispatches hold its slots.
+            if (room_.acquire(shard, 1) == 1) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    void count(std::atomic<std::size_t> &counter)
+    {
+        if (instrumented) {
+            counter.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    bool shed(Priority priority)
+    {
+        if (priority != Priority::Low ||
+                !overloaded_.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        count(numShed_);
+        return true;
+    }
+
+    std::chrono::steady_clock::rep stamp() const
+    {
+        return instrumented && sheddingTarget_.count() > 0
+            ? std::chrono::steady_clock::now().time_since_epoch().count()
+            : 0;
+    }
+
+    // Called by workers with the time each task was queued. As in CoDel,
+    // tasks waiting longer than the target for a whole interval mean that
+    // the queue no longer absorbs bursts but stands; a single task waiting
+    // less means it drains again.
+    void trackSojourn(std::chrono::steady_clock::rep enqueued)
+    {
+        const auto now =
+            std::chrono::steady_clock::now().time_since_epoch().count();
+        const std::chrono::steady_clock::duration sojourn{now - enqueued};
+        if (sojourn < sheddingTarget_) {
+            if (firstAbove_.load(std::memory_order_relaxed) != 0) {
+                firstAbove_.store(0, std::memory_order_relaxed);
+            }
+            setOverloaded(false, sojourn);
+            return;
+        }
+
+        auto firstAbove = firstAbove_.load(std::memory_order_relaxed);
+        if (firstAbove == 0) {
+            firstAbove_.compare_exchange_strong(firstAbove, now,
+                    std::memory_order_relaxed);
+        } else if (std::chrono::steady_clock::duration{now - firstAbove} >=
+                sheddingInterval_) {
+            setOverloaded(true, sojourn);
+        }
+    }
+
+    void setOverloaded(
+            bool overloaded,
+            std::chrono::steady_clock::duration sojourn)
+    {
+        if (overloaded_.load(std::memory_order_relaxed) == overloaded ||
+                overloaded_.exchange(overloaded) == overloaded) {
+            return;
+        }
+        if (onOverload_) {
+            try {
+                onOverload_(overloaded, std::chrono::duration_cast<
+                        std::chrono::microseconds>(sojourn));
+            } catch (...) {
+            }
+        }
+    }
+
+    template <typename Rep, typename Period>
+    static std::chrono::steady_clock::time_point deadlineAfter(
+            const std::chrono::duration<Rep, Period> &timeout)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>{timeout} >=
+                std::chrono::steady_clock::time_point::max() - now) {
+            return std::chrono::steady_clock::time_point::max();
+        }
+        return now + std::chrono::duration_cast<
+            std::chrono::steady_clock::duration>(timeout);
+    }
+
+    // Adds a worker if every worker is busy and the growth policy says the
+    // queue is backing up. Cheap when the pool is at its maximum size.
+    void maybeGrow()
+    {
+        const std::size_t numThreads = numThreads_;
+        if (numThreads >= maxThreads_ || numIdle_ > 0) {
+            return;
+        }
+        if (numThreads > 0) {
+            if (growthPolicy_ == GrowthPolicy::QueueDepth) {
+                if (queuedApprox() <= growthQueueDepth_) {
+                    return;
+                }
+            } else if (std::chrono::steady_clock::now().time_since_epoch() -
+                    std::chrono::steady_clock::duration{lastDequeue_} <
+                    growthWaitTime_) {
+                return;
+            }
+        }
+
+        // Without any worker the task would be stranded, so wait our turn.
+        std::unique_lock<std::mutex> lk{workersMutex_, std::defer_lock};
+        if (numThreads == 0) {
+            lk.lock();
+        } else if (!lk.try_lock()) {
+            return;
+        }
+        if (state_ == State::Running && numThreads_ < maxThreads_) {
+            reapWorkers();
+            spawnWorker();
+        }
+    }
+
+    // Runs rounds of no-op tasks through every node's queue, so that the
+    // workers' code paths, the queues' producer state and the allocator's
+    // caches are warm by the time the first real task arrives. Bypasses
+    // `maybeGrow`, lest an elastic pool grow to its maximum size.
+    void warmUp()
+    {
+        std::atomic<std::size_t> pending{0};
+        const std::vector<Task<void>> tasks(4 * numThreads_, [&pending] {
+            pending.fetch_sub(1, std::memory_order_release);
+        });
+        const auto n = tasks.size();
+        const auto shard = detail::threadShard();
+        detail::CountedAllocations allocations{queueBytes_};
+
+        for (int round = 0; round < 8; ++round) {
+            for (auto &q: queues_) {
+                if (capacity_ > 0) {
+                    room_.overdraw(shard, n);
+                }
+                pending += n;
+                q.enqueue_bulk(Stamped<decltype(tasks.cbegin())>{
+                        tasks.cbegin(), stamp()}, n);
+                events_.notify(n);
+            }
+            while (pending.load(std::memory_order_acquire) > 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Must be called with `workersMutex_` held.
+    void spawnWorker()
+    {
+        const auto slot = static_cast<std::size_t>(
+                std::find(slots_.cbegin(), slots_.cend(), false) -
+                slots_.cbegin());
+        if (slot == slots_.size()) {
+            slots_.emplace_back(false);
+        }
+
+        workers_.emplace_back();
+        auto &w = workers_.back();
+        w.slot = slot;
+        place(w);
+
+        ++numThreads_;
+        try {
+            w.thread = std::thread{[this, &w] { work(w); }};
+        } catch (...) {
+            --numThreads_;
+            workers_.pop_back();
+            throw;
+        }
+        slots_[slot] = true;
+    }
+
+    // Must be called with `workersMutex_` held.
+    void reapWorkers()
+    {
+        for (auto it = workers_.begin(); it != workers_.end(); ) {
+            if (it->retired) {
+                it->thread.join();
+                it = workers_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Lets the calling worker retire if `setConcurrency` asked for fewer.
+    bool claimRetirement()
+    {
+        auto n = numRetirees_.load(std::memory_order_relaxed);
+        while (n > 0) {
+            if (numRetirees_.compare_exchange_weak(n, n - 1,
+                        std::memory_order_acquire,
+                        std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Retires `self` unless it is needed to keep the pool at its minimum
+    // size, or the pool is shutting down (shutdown stops every worker).
+    bool retireIdle(Worker &self)
+    {
+        std::unique_lock<std::mutex> lk{workersMutex_};
+        if (state_ != State::Running || numThreads_ <= minThreads_) {
+            return false;
+        }
+
+        // A dispatch that raced with the timeout either sees the lower
+        // thread count and grows the pool, or its task is seen here.
+        --numThreads_;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (queuedApprox() > 0) {
+            ++numThreads_;
+            return false;
+        }
+        releaseSlot(self);
+        return true;
+    }
+
+    void work(Worker &self)
+    {
+        currentPool() = this;
+        currentNode() = self.node;
+        if (!self.cpus.empty()) {
+            detail::setAffinity(self.cpus);
+        }
+        if (stackPrefault_ > 0) {
+            detail::prefaultStack(stackPrefault_);
+        }
+
+        ConsumerTokens ctoks;
+        ctoks.reserve(queues_.size());
+        for (auto &q: queues_) {
+            ctoks.emplace_back(q);
+        }
+        typename Policy::IdleWait idleWait{waitStrategy_, spinCount_};
+        std::vector<Entry> batch(maxBatchSize_);
+        std::size_t batchSize = 1;
+
+        for (;;) {
+            if (numRetirees_.load(std::memory_order_relaxed) > 0 &&
+                    claimRetirement()) {
+                std::unique_lock<std::mutex> lk{workersMutex_};
+                releaseSlot(self);
+                return;
+            }
+
+            const auto max = fairBatchSize(batchSize);
+            const auto n = tryDequeue(ctoks, self.node, batch, max);
+            if (n > 0) {
+                if (capacity_ > 0) {
+                    room_.release(detail::threadShard(), n);
+                    roomFreed_.notify(n);
+                }
+                if (instrumented &&
+                        growthPolicy_ == GrowthPolicy::WaitTime) {
+                    lastDequeue_ = std::chrono::steady_clock::now()
+                        .time_since_epoch().count();
+                }
+
+                // A full batch means there may well be more to take next
+                // time; a partial one that the queue ran dry.
+                batchSize = n == max
+                    ? std::min(2 * batchSize, maxBatchSize_)
+                    : std::max(batchSize / 2, std::size_t{1});
+
+                for (std::size_t i = 0; i < n; ++i) {
+                    if (stopRequested()) {
+                        for (auto j = i; j < n; ++j) {
+                            stash(std::move(batch[j].task));
+                        }
+                        return;
+                    }
+                    if (instrumented && sheddingTarget_.count() > 0) {
+                        trackSojourn(batch[i].enqueued());
+                    }
+                    batch[i].task();
+                    batch[i].task = TaskType{};
+                }
+                continue;
+            }
 
-        for (std::size_t i = 0; i < numThreads_; ++i) {
-            threads_.emplace_back([this] {
-                moodycamel::ConsumerToken ctok{tasks_};
-                Task<void> t;
+            if (overloaded_.load(std::memory_order_relaxed)) {
+                firstAbove_.store(0, std::memory_order_relaxed);
+                setOverloaded(false, std::chrono::steady_clock::duration{});
+            }
+
+            // While draining, the queue only ever runs empty for good once
+            // no dispatch is in flight; the workers then stop one by one.
+            const auto state = state_.load();
+            if (state == State::Stopping || (state == State::Draining &&
+                        (closed_ || stopRequested()))) {
+                return;
+            }
 
-                tasks_.wait_dequeue(ctok, t);
-                while (t) {
-                    t();
-                    tasks_.wait_dequeue(ctok, t);
+            // Announce the wait before looking once more, so that any
+            // dispatch we do not see here notifies us.
+            ++numIdle_;
+            const auto key = events_.prepareWait();
+            bool woken = true;
+            bool trim = false;
+            auto timeout = idleTimeout_;
+            if (queuedApprox() > 0 || closed_ || numRetirees_ > 0) {
+                events_.cancelWait();
+            } else {
+                // Only trim if the queue grew since the last time.
+                if (trimIdleAfter_.count() > 0 &&
+                        queueBytes_ > trimmedBytes_) {
+                    trim = true;
+                    timeout = std::min(timeout, trimIdleAfter_);
                 }
-            });
+                woken = idleWait(events_, key,
+                        std::chrono::steady_clock::now() + timeout);
+            }
+            --numIdle_;
+
+            if (!woken && trim) {
+                trimMemory();
+            }
+            if (!woken && timeout == idleTimeout_ && retireIdle(self)) {
+                return;
+            }
         }
     }
 
-    ~TaskPool()
+    bool stopRequested() const
     {
-        destroyed_ = true;  // prevent any future task dispatches
+        const auto state = state_.load(std::memory_order_acquire);
+        if (state == State::Running) {
+            return false;
+        }
+        return state == State::Stopping ||
+            (deadline_ != std::chrono::steady_clock::time_point::max() &&
+             std::chrono::steady_clock::now() >= deadline_);
+    }
+
+    void stash(TaskType &&task)
+    {
+        std::unique_lock<std::mutex> lk{unexecutedMutex_};
+        unexecuted_.emplace_back(std::move(task));
+    }
 
-        for (std::size_t i = 0; i < numThreads_; ++i) {
-            tasks_.enqueue(Task<void>{});
+    std::vector<TaskType> shutdown(
+            ShutdownMode mode,
+            std::chrono::steady_clock::time_point deadline)
+    {
+        if (currentPool() == this) {
+            throw std::logic_error{
+                "task pool cannot be shut down from its own workers"};
         }
-        for (auto &t: threads_) {
-            t.join();
+
+        std::unique_lock<std::mutex> lk{shutdownMutex_};
+        if (state_ != State::Running) {
+            return {};
         }
 
-        // pump until empty
-        std::atomic<std::size_t> numDones{0};
-        for (auto &t: threads_) {
-            t = std::thread([this, &numDones] {
-                moodycamel::ConsumerToken ctok{tasks_};
-                Task<void> t;
+        {
+            std::unique_lock<std::mutex> lk{workersMutex_};
+            deadline_ = deadline;
+            state_ = mode == ShutdownMode::Drain
+                ? State::Draining
+                : State::Stopping;
+        }
+        roomFreed_.notifyAll();
+        while (!inFlight_.isZero()) {
+            std::this_thread::yield();
+        }
 
-                do {
-                    while (tasks_.try_dequeue(ctok, t)) {
-                        t();
-                    }
-                } while (numThreads_ ==
-                        numDones.fetch_add(1, std::memory_order_acq_rel) + 1);
-            });
+        // From now on, only tasks still running may add to the queue. The
+        // worker list no longer changes either, as nothing spawns or reaps
+        // workers after the state has left `State::Running`.
+        closed_ = true;
+        events_.notifyAll();
+        for (auto &w: workers_) {
+            w.thread.join();
         }
-        for (auto &t: threads_) {
-            t.join();
+        workers_.clear();
+        numThreads_ = 0;
+        state_ = State::Terminated;
+
+        Entry e;
+        for (auto &q: queues_) {
+            while (q.try_dequeue(e)) {
+                unexecuted_.emplace_back(std::move(e.task));
+            }
         }
+        return std::move(unexecuted_);
     }
 
-    TaskPool(const TaskPool &other) = delete;
-    TaskPool(TaskPool &&other) = delete;
-    TaskPool & operator=(const TaskPool &other) = delete;
-    TaskPool & operator=(TaskPool &&other) = delete;
+    template <typename T>
+    void checkArgs(const T &task) const
+    {
+        if (!task) {
+            throw std::invalid_argument{"task has no target callable object"};
+        }
+    }
 
-    void dispatch(const Task<void> &task)
+    template <typename Iter>
+    void checkArgs(Iter first, Iter last) const
     {
-        checkArgs(task);
+        using T = typename std::iterator_traits<Iter>::value_type;
 
-        tasks_.enqueue(task);
+        if (!std::all_of(first, last, [](const T &t) { return t; })) {
+            throw std::invalid_argument{"task has no target callable object"};
+        }
     }
 
-    template <typename R>
-    std::future<R> dispatch(const Task<R> &task)
+private:
+    typename Policy::Allocator allocator_;
+
+    std::atomic<State> state_{State::Running};
+    std::chrono::steady_clock::time_point deadline_;
+    detail::ShardedCounter inFlight_;
+    std::atomic<bool> closed_{false};
+    std::mutex shutdownMutex_;
+    std::mutex unexecutedMutex_;
+    std::vector<TaskType> unexecuted_;
+
+    std::mutex workersMutex_;
+    std::list<Worker> workers_;
+    std::atomic<std::size_t> numThreads_{0};
+    std::atomic<std::size_t> minThreads_;
+    std::atomic<std::size_t> maxThreads_;
+    std::atomic<std::size_t> numIdle_{0};
+    std::atomic<std::size_t> numRetirees_{0};
+    const std::chrono::milliseconds idleTimeout_;
+    const GrowthPolicy growthPolicy_;
+    const std::size_t growthQueueDepth_;
+    const std::chrono::microseconds growthWaitTime_;
+    std::atomic<std::chrono::steady_clock::rep> lastDequeue_{0};
+
+    const Placement placement_;
+    const std::vector<int> cpus_;
+    const std::vector<NumaNode> nodes_;
+    std::vector<std::size_t> cpuNodes_;  // indexed by CPU
+    std::vector<int> compactCpus_;
+    std::vector<std::vector<std::size_t>> stealOrder_;
+    std::vector<bool> slots_;  // worker slots in use, for placement
+
+    const WaitStrategy waitStrategy_;
+    const std::size_t spinCount_;
+    const std::size_t maxBatchSize_;
+    const std::size_t stackPrefault_;
+
+    // Idle workers wait here; dispatches only pay for a wake-up system call
+    // if a worker actually went to sleep.
+    detail::EventCount events_;
+    std::atomic<std::size_t> queueBytes_{0};  // outlives `queues_`
+    std::vector<Queue> queues_;
+    const std::chrono::milliseconds trimIdleAfter_;
+    std::atomic<bool> trimming_{false};
+    std::atomic<std::size_t> trimmedBytes_{
+        std::numeric_limits<std::size_t>::max()};  // none until constructed
+
+    const std::size_t capacity_;
+    const RejectionPolicy rejectionPolicy_;
+    detail::ShardedSlots room_;
+    detail::EventCount roomFreed_;  // dispatches waiting for room wait here
+    std::atomic<std::size_t> numRejected_{0};
+    std::atomic<std::size_t> numDiscarded_{0};
+    std::atomic<std::size_t> numCallerRuns_{0};
+    const std::size_t saturationQueueDepth_;
+    std::atomic<std::size_t> numSaturatedRuns_{0};
+
+    const std::chrono::steady_clock::duration sheddingTarget_;
+    const std::chrono::steady_clock::duration sheddingInterval_;
+    const std::function<void(bool, std::chrono::microseconds)> onOverload_;
+    std::atomic<bool> overloaded_{false};
+    std::atomic<std::chrono::steady_clock::rep> firstAbove_{0};
+    std::atomic<std::size_t> numShed_{0};
+};
+
+using TaskPool = BasicTaskPool<>;
+
+struct AsyncCacheOptions {
+    // The most entries kept, rounded up to a multiple of the number of
+    // shards.
+    std::size_t capacity = 1024;
+
+    // Entries older than this are loaded anew on access; zero keeps them
+    // until evicted.
+    std::chrono::milliseconds expireAfterWrite{0};
+
+    // Entries older than this are reloaded in the background on access,
+    // while the old value keeps being returned; zero never refreshes.
+    std::chrono::milliseconds refreshAfterWrite{0};
+};
+
+struct AsyncCacheStats {
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t refreshes = 0;
+    std::size_t evictions = 0;
+};
+
+// A cache whose loader runs on a task pool. Concurrent misses for a key
+// share a single load, and `get` hands out futures right away, so that
+// nobody waits on a lock while a value loads. Entries live in shards with
+// a lock and a fixed number of slots each, and are evicted with the CLOCK
+// algorithm: a slot that was hit since the hand last passed it gets another
+// round. Failed loads are not kept. `K` must be default-constructible. The
+// destructor waits for loads in flight. `Clock` times expiry and refreshes;
+// tests may substitute one they control.
+template <typename K, typename V, typename Hash = std::hash<K>,
+        typename Policy = DefaultTaskPoolPolicy,
+        typename Clock = std::chrono::steady_clock>
+class AsyncCache final {
+public:
+    using Loader = std::function<V(const K &)>;
+
+    static constexpr std::size_t numShards = 16;
+
+    AsyncCache(BasicTaskPool<Policy> &pool, Loader loader,
+            const AsyncCacheOptions &options = AsyncCacheOptions{})
+        : pool_(pool),
+          loader_{std::move(loader)},
+          expireAfter_{options.expireAfterWrite},
+          refreshAfter_{options.refreshAfterWrite}
     {
-        checkArgs(task);
+        if (options.capacity == 0) {
+            throw std::invalid_argument{"invalid cache capacity"};
+        }
+        const auto perShard = (options.capacity + numShards - 1) / numShards;
+        for (auto &shard: shards_) {
+            shard.slots.resize(perShard);
+        }
+    }
 
-        auto p = std::make_shared<std::promise<R>>();
-        tasks_.enqueue([p, task]() mutable {
-            try {
-                p->set_value(task());
-            } catch (...) {
-                p->set_exception(std::current_exception());
-            }
-        });
-        return p->get_future();
+    AsyncCache(const AsyncCache &other) = delete;
+    AsyncCache & operator=(const AsyncCache &other) = delete;
+
+    ~AsyncCache()
+    {
+        std::unique_lock<std::mutex> lk{m_};
+        cv_.wait(lk, [this] { return numLoads_ == 0; });
     }
 
-    template <typename Iter>
-    void dispatch(Iter first, Iter last)
+    // The value of `key`, loading it on a miss. An entry due for a refresh
+    // still returns its current value, while a reload runs in the
+    // background.
+    std::shared_future<V> get(const K &key)
     {
-        if (first >= last) {
-            return;
+        auto &shard = shardOf(key);
+        const auto now = Clock::now();
+        std::shared_ptr<Load> load;
+        std::shared_future<V> future;
+        {
+            std::lock_guard<std::mutex> lk{shard.m};
+            const auto it = shard.index.find(key);
+            if (it != shard.index.end() &&
+                    !expired(shard.slots[it->second], now)) {
+                auto &slot = shard.slots[it->second];
+                ++shard.stats.hits;
+                slot.referenced = true;
+                if (!slot.loading && !slot.refreshing && due(slot, now)) {
+                    ++shard.stats.refreshes;
+                    slot.refreshing = true;
+                    load = std::make_shared<Load>(*this, key, it->second,
+                            slot.generation, true);
+                }
+                future = slot.future;
+            } else {
+                ++shard.stats.misses;
+                const auto i = it != shard.index.end() ?
+                    it->second : claim(shard, key);
+                auto &slot = shard.slots[i];
+                slot.key = key;
+                slot.generation = ++shard.generation;
+                slot.used = true;
+                slot.loading = true;
+                slot.refreshing = false;
+                slot.referenced = false;
+                load = std::make_shared<Load>(*this, key, i, slot.generation,
+                        false);
+                slot.future = load->future();
+                future = slot.future;
+            }
         }
-        checkArgs(first, last);
+        if (load) {
+            pool_.dispatch(Runner{std::move(load)});
+        }
+        return future;
+    }
 
-        tasks_.enqueue_bulk(first, last - first);
+    // Sets `value` to that of `key` if it is loaded and has not expired.
+    // Never loads or waits.
+    bool getIfPresent(const K &key, V &value)
+    {
+        auto &shard = shardOf(key);
+        std::lock_guard<std::mutex> lk{shard.m};
+        const auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            return false;
+        }
+        auto &slot = shard.slots[it->second];
+        if (slot.loading || expired(slot, Clock::now())) {
+            return false;
+        }
+        slot.referenced = true;
+        value = slot.future.get();
+        return true;
     }
 
-    template <typename R, typename Iter>
-    std::vector<std::future<R>> dispatch(Iter first, Iter last)
+    // Drops the entry of `key`; a load in flight still completes the
+    // futures handed out for it, but its value is not kept.
+    void invalidate(const K &key)
     {
-        if (first >= last) {
-            return {};
+        auto &shard = shardOf(key);
+        std::lock_guard<std::mutex> lk{shard.m};
+        const auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            remove(shard, it->second);
         }
-        checkArgs(first, last);
+    }
 
-        std::vector<std::future<R>> futures;
-        futures.reserve(last - first);
-        for (auto it = first; it != last; ++it) {
-            futures.emplace_back(dispatch<R>(*it));
+    std::size_t size() const
+    {
+        std::size_t n = 0;
+        for (const auto &shard: shards_) {
+            std::lock_guard<std::mutex> lk{shard.m};
+            n += shard.index.size();
         }
-        return futures;
+        return n;
     }
 
-    template <typename Iter>
-    void dispatchSync(Iter first, Iter last)
+    AsyncCacheStats stats() const
     {
-        if (first >= last) {
-            return;
+        AsyncCacheStats stats;
+        for (const auto &shard: shards_) {
+            std::lock_guard<std::mutex> lk{shard.m};
+            stats.hits += shard.stats.hits;
+            stats.misses += shard.stats.misses;
+            stats.refreshes += shard.stats.refreshes;
+            stats.evictions += shard.stats.evictions;
         }
-        checkArgs(first, last);
+        return stats;
+    }
 
-        std::atomic<std::size_t> count{static_cast<std::size_t>(last - first)};
-        std::mutex m;
-        std::condition_variable cv;
+private:
+    struct Slot {
+        K key{};
+        std::shared_future<V> future;
+        typename Clock::time_point written;
+        std::uint64_t generation = 0;
+        bool used = false;
+        bool loading = false;
+        bool refreshing = false;
+        bool referenced = false;
+    };
 
-        for (auto it = first; it != last; ++it) {
-            dispatch(std::bind([&](Task<void> t) {
-                t();
+    struct Shard {
+        mutable std::mutex m;
+        std::unordered_map<K, std::size_t, Hash> index;
+        std::vector<Slot> slots;
+        std::size_t hand = 0;
+        std::uint64_t generation = 0;
+        AsyncCacheStats stats;
+    };
 
-                std::unique_lock<std::mutex> lk{m};
-                if (--count == 0) {
-                    cv.notify_all();
-                }
-            }, *it));
+    // A load or refresh of one slot. It only updates the slot if the slot
+    // still holds the same generation, that is, if it was neither evicted
+    // nor invalidated meanwhile. If it is destroyed without having run, for
+    // example because the pool was shut down, it fails with a broken
+    // promise.
+    class Load final {
+    public:
+        Load(AsyncCache &cache, const K &key, std::size_t slot,
+                std::uint64_t generation, bool refresh)
+            : cache_{&cache},
+              key_{key},
+              slot_{slot},
+              generation_{generation},
+              refresh_{refresh},
+              future_{promise_.get_future().share()}
+        {
+            std::lock_guard<std::mutex> lk{cache_->m_};
+            ++cache_->numLoads_;
         }
 
-        std::unique_lock<std::mutex> lk{m};
-        cv.wait(lk, [&count] { return count == 0; });
-    }
+        Load(const Load &other) = delete;
+        Load & operator=(const Load &other) = delete;
 
-    template <typename R, typename Iter>
-    std::vector<R> dispatchSync(Iter first, Iter last)
-    {
-        if (first >= last) {
-            return {};
+        ~Load()
+        {
+            if (!ran_) {
+                fail(std::make_exception_ptr(std::future_error{
+                            std::future_errc::broken_promise}));
+            }
+            std::lock_guard<std::mutex> lk{cache_->m_};
+            --cache_->numLoads_;
+            cache_->cv_.notify_all();
         }
-        checkArgs(first, last);
 
-        std::vector<std::future<R>> futures;
-        futures.reserve(last - first);
+        const std::shared_future<V> & future() const
+        {
+            return future_;
+        }
 
-        for (auto it = first; it != last; ++it) {
-            futures.emplace_back(dispatch<R>(std::bind([&](decltype(*it) t) {
-                return t();
-            }, *it)));
+        // The slot is updated before the future completes, and under the
+        // same lock, so whoever sees the value also finds it in the cache.
+        void run()
+        {
+            ran_ = true;
+            try {
+                auto value = cache_->loader_(key_);
+                auto &shard = cache_->shardOf(key_);
+                std::lock_guard<std::mutex> lk{shard.m};
+                auto &slot = shard.slots[slot_];
+                if (slot.generation == generation_) {
+                    slot.future = future_;
+                    slot.written = Clock::now();
+                    slot.loading = false;
+                    slot.refreshing = false;
+                }
+                promise_.set_value(std::move(value));
+            } catch (...) {
+                fail(std::current_exception());
+            }
         }
 
-        std::vector<R> results;
-        results.reserve(last - first);
+    private:
+        // A failed refresh keeps the old value.
+        void fail(std::exception_ptr error)
+        {
+            auto &shard = cache_->shardOf(key_);
+            std::lock_guard<std::mutex> lk{shard.m};
+            auto &slot = shard.slots[slot_];
+            if (slot.generation == generation_) {
+                if (refresh_) {
+                    slot.refreshing = false;
+                } else {
+                    cache_->remove(shard, slot_);
+                }
+            }
+            promise_.set_exception(std::move(error));
+        }
 
-        for (auto &f: futures) {
-            results.emplace_back(f.get());
+        AsyncCache *cache_;
+        K key_;
+        std::size_t slot_;
+        std::uint64_t generation_;
+        bool refresh_;
+        std::promise<V> promise_;
+        std::shared_future<V> future_;
+        bool ran_ = false;
+    };
+
+    class Runner final {
+    public:
+        explicit Runner(std::shared_ptr<Load> load) : load_{std::move(load)}
+        {
         }
-        return results;
+
+        void operator()() const
+        {
+            load_->run();
+        }
+
+    private:
+        std::shared_ptr<Load> load_;
+    };
+
+    bool expired(const Slot &slot, typename Clock::time_point now) const
+    {
+        return !slot.loading && expireAfter_.count() > 0 &&
+            now - slot.written >= expireAfter_;
     }
 
-    template <typename Iter>
-    void dispatchSerial(Iter first, Iter last)
+    bool due(const Slot &slot, typename Clock::time_point now) const
     {
-        if (first >= last) {
-            return;
-        }
-        checkArgs(first, last);
+        return refreshAfter_.count() > 0 && now - slot.written >= refreshAfter_;
+    }
 
-        auto tasks = std::make_shared<std::vector<Task<void>>>(first, last);
-        dispatch([tasks] {
-            for (const auto &t: *tasks) {
-                t();
+    // Finds a slot for `key`, evicting the first entry the hand finds that
+    // was not hit since the hand last passed it.
+    std::size_t claim(Shard &shard, const K &key)
+    {
+        for (;;) {
+            const auto i = shard.hand;
+            shard.hand = (shard.hand + 1) % shard.slots.size();
+            auto &slot = shard.slots[i];
+            if (slot.used && slot.referenced) {
+                slot.referenced = false;
+                continue;
             }
-        });
+            if (slot.used) {
+                ++shard.stats.evictions;
+                remove(shard, i);
+            }
+            shard.index.emplace(key, i);
+            return i;
+        }
     }
 
-    template <typename R, typename Iter>
-    std::vector<std::future<R>> dispatchSerial(Iter first, Iter last)
+    void remove(Shard &shard, std::size_t i)
     {
-        if (first >= last) {
-            return {};
+        auto &slot = shard.slots[i];
+        shard.index.erase(slot.key);
+        slot.future = std::shared_future<V>{};
+        slot.generation = ++shard.generation;
+        slot.used = false;
+    }
+
+    Shard & shardOf(const K &key)
+    {
+        return shards_[Hash{}(key) % numShards];
+    }
+
+    BasicTaskPool<Policy> &pool_;
+    const Loader loader_;
+    const std::chrono::milliseconds expireAfter_;
+    const std::chrono::milliseconds refreshAfter_;
+    std::array<Shard, numShards> shards_;
+
+    std::mutex m_;
+    std::condition_variable cv_;
+    std::size_t numLoads_ = 0;
+};
+
+struct TaskGraphTiming {
+    std::chrono::steady_clock::duration total{};
+    std::vector<std::chrono::steady_clock::duration> nodes;
+};
+
+// A graph of tasks, where an edge from one node to another means that the
+// first has to complete before the second starts. `run` dispatches the
+// nodes without predecessors, and every node that completes dispatches the
+// successors it was the last predecessor of, so no worker ever waits on
+// another. Of those successors, the one on the longest remaining path, as
+// timed in the previous run, runs next on the same worker; the others are
+// dispatched in the order of their remaining paths. A graph may be run any
+// number of times, but only once at a time, and must not be changed while
+// it runs.
+class TaskGraph final {
+public:
+    using Node = std::size_t;
+    using Clock = std::chrono::steady_clock;
+
+    TaskGraph() = default;
+
+    TaskGraph(const TaskGraph &other) = delete;
+    TaskGraph & operator=(const TaskGraph &other) = delete;
+
+    Node add(Task<void> task)
+    {
+        if (!task) {
+            throw std::invalid_argument{"task has no target callable object"};
         }
-        checkArgs(first, last);
+        nodes_.emplace_back();
+        nodes_.back().task = std::move(task);
+        dirty_ = true;
+        return nodes_.size() - 1;
+    }
 
-        auto promises =
-            std::make_shared<std::vector<std::promise<R>>>(last - first);
-        std::vector<std::future<R>> futures;
-        futures.reserve(last - first);
-        for (auto &p: *promises) {
-            futures.emplace_back(p.get_future());
+    // Makes `after` wait for `before`.
+    void precede(Node before, Node after)
+    {
+        if (before >= nodes_.size() || after >= nodes_.size()) {
+            throw std::out_of_range{"no such node"};
         }
+        nodes_[before].successors.push_back(after);
+        ++nodes_[after].numPredecessors;
+        dirty_ = true;
+    }
 
-        auto tasks = std::make_shared<std::vector<Task<R>>>(first, last);
-        dispatch([tasks, promises] {
-            for (std::size_t i = 0; i < tasks->size(); ++i) {
-                try {
-                    (*promises)[i].set_value((*tasks)[i]());
-                } catch (...) {
-                    (*promises)[i].set_exception(std::current_exception());
-                }
+    std::size_t size() const
+    {
+        return nodes_.size();
+    }
+
+    // Runs every node on `pool` and waits for them. Once a node throws, the
+    // nodes that have not started yet are skipped, and `run` rethrows the
+    // first exception. Nodes dropped by the pool without running, for
+    // example by `shutdownNow`, make `run` throw a broken promise. Throws
+    // `std::invalid_argument` if the graph has a cycle.
+    template <typename Policy>
+    void run(BasicTaskPool<Policy> &pool)
+    {
+        if (running_.exchange(true)) {
+            throw std::logic_error{"task graph is already running"};
+        }
+        struct Running {
+            std::atomic<bool> &running;
+
+            ~Running()
+            {
+                running = false;
             }
-        });
-        return futures;
+        } guard{running_};
+
+        prepare();
+        const auto start = Clock::now();
+        detail::SyncState state;
+        for (const auto root: roots_) {
+            spawn(pool, state, root);
+        }
+        state.wait();
+        timing_.total = Clock::now() - start;
+        if (error_) {
+            auto error = std::move(error_);
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+        state.check(nodes_.size());
     }
 
-    void dispatchOnce(std::once_flag &flag, const Task<void> &task)
+    // How long the last run, and each of its nodes, took. Skipped nodes
+    // took zero.
+    const TaskGraphTiming & timing() const
     {
-        dispatch([task, &flag] {
-            std::call_once(flag, task);
-        });
+        return timing_;
     }
 
 private:
-    template <typename T>
-    void checkArgs(const T &task) const
+    struct Vertex {
+        Task<void> task;
+        std::vector<Node> successors;
+        std::size_t numPredecessors = 0;
+        Clock::duration path{};  // the longest path from here to a sink
+    };
+
+    // Runs one node, and those of its successors that it makes ready
+    // first. Copies count towards the run, so that the run does not end
+    // while any of them is left.
+    template <typename Pool>
+    class NodeTask final {
+    public:
+        NodeTask(TaskGraph &graph, Pool &pool, detail::SyncState &state,
+                Node node)
+            : graph_{&graph}, pool_{&pool}, state_{&state}, node_{node}
+        {
+            state_->hold();
+        }
+
+        NodeTask(const NodeTask &other)
+            : graph_{other.graph_},
+              pool_{other.pool_},
+              state_{other.state_},
+              node_{other.node_}
+        {
+            state_->hold();
+        }
+
+        NodeTask(NodeTask &&other)
+            : graph_{other.graph_},
+              pool_{other.pool_},
+              state_{other.state_},
+              node_{other.node_}
+        {
+            other.state_ = nullptr;
+        }
+
+        ~NodeTask()
+        {
+            if (state_) {
+                state_->release();
+            }
+        }
+
+        NodeTask & operator=(const NodeTask &other) = delete;
+
+        void operator()() const
+        {
+            graph_->execute(*pool_, *state_, node_);
+        }
+
+    private:
+        TaskGraph *graph_;
+        Pool *pool_;
+        detail::SyncState *state_;
+        Node node_;
+    };
+
+    // Checks for cycles if the graph changed, resets the counters, and
+    // orders roots and successors by their longest remaining paths, as
+    // timed in the last run; nodes not timed yet count as one tick.
+    void prepare()
     {
-        if (destroyed_) {
-            throw std::runtime_error{"task pool already destroyed"};
+        const auto n = nodes_.size();
+        if (dirty_) {
+            order_.clear();
+            for (Node i = 0; i < n; ++i) {
+                if (nodes_[i].numPredecessors == 0) {
+                    order_.push_back(i);
+                }
+            }
+            std::vector<std::size_t> indegree(n);
+            for (Node i = 0; i < n; ++i) {
+                indegree[i] = nodes_[i].numPredecessors;
+            }
+            for (std::size_t k = 0; k < order_.size(); ++k) {
+                for (const auto s: nodes_[order_[k]].successors) {
+                    if (--indegree[s] == 0) {
+                        order_.push_back(s);
+                    }
+                }
+            }
+            if (order_.size() != n) {
+                throw std::invalid_argument{"task graph has a cycle"};
+            }
+            pending_ = std::vector<std::atomic<std::size_t>>(n);
+            timing_.nodes.assign(n, Clock::duration::zero());
+            dirty_ = false;
         }
-        if (!task) {
-            throw std::invalid_argument{"task has no target callable object"};
+
+        const auto byPath = [this](Node a, Node b) {
+            return nodes_[a].path > nodes_[b].path;
+        };
+        roots_.clear();
+        for (auto it = order_.rbegin(); it != order_.rend(); ++it) {
+            auto &v = nodes_[*it];
+            std::sort(v.successors.begin(), v.successors.end(), byPath);
+            v.path = std::max(timing_.nodes[*it], Clock::duration{1}) +
+                (v.successors.empty() ?
+                 Clock::duration::zero() : nodes_[v.successors[0]].path);
+            if (v.numPredecessors == 0) {
+                roots_.push_back(*it);
+            }
+        }
+        std::sort(roots_.begin(), roots_.end(), byPath);
+
+        for (Node i = 0; i < n; ++i) {
+            pending_[i].store(nodes_[i].numPredecessors,
+                    std::memory_order_relaxed);
+            timing_.nodes[i] = Clock::duration::zero();
         }
+        failed_.store(false, std::memory_order_relaxed);
     }
 
-    template <typename Iter>
-    void checkArgs(Iter first, Iter last) const
+    template <typename Pool>
+    void spawn(Pool &pool, detail::SyncState &state, Node node)
     {
-        using T = typename std::iterator_traits<Iter>::value_type;
+        try {
+            pool.dispatch(NodeTask<Pool>{*this, pool, state, node});
+        } catch (...) {
+            fail(std::current_exception());
+            execute(pool, state, node);
+        }
+    }
+
+    template <typename Pool>
+    void execute(Pool &pool, detail::SyncState &state, Node node)
+    {
+        for (;;) {
+            auto &v = nodes_[node];
+            state.run([this, &v, node] {
+                if (failed_.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                const auto start = Clock::now();
+                try {
+                    v.task();
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+                timing_.nodes[node] = Clock::now() - start;
+            });
 
-        if (destroyed_) {
-            throw std::runtime_error{"task pool already destroyed"};
+            auto next = nodes_.size();
+            for (const auto s: v.successors) {
+                if (pending_[s].fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                    continue;
+                }
+                if (next == nodes_.size()) {
+                    next = s;
+                } else {
+                    spawn(pool, state, s);
+                }
+            }
+            if (next == nodes_.size()) {
+                return;
+            }
+            node = next;
         }
-        if (!std::all_of(first, last, [](const T &t) { return t; })) {
-            throw std::invalid_argument{"task has no target callable object"};
+    }
+
+    void fail(std::exception_ptr error)
+    {
+        std::lock_guard<std::mutex> lk{m_};
+        if (!error_) {
+            error_ = std::move(error);
         }
+        failed_.store(true, std::memory_order_relaxed);
     }
 
-private:
-    std::atomic<bool> destroyed_{false};
-    const std::size_t numThreads_;
-    std::vector<std::thread> threads_;
-    moodycamel::BlockingConcurrentQueue<Task<void>> tasks_;
+    std::vector<Vertex> nodes_;
+    bool dirty_ = true;
+    std::vector<Node> order_;  // topological
+    std::vector<Node> roots_;
+    std::vector<std::atomic<std::size_t>> pending_;
+    TaskGraphTiming timing_;
+
+    std::atomic<bool> running_{false};
+    std::atomic<bool> failed_{false};
+    std::mutex m_;
+    std::exception_ptr error_;
 };
 
 template <typename R, typename S>
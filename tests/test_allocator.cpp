@@ -0,0 +1,237 @@
+#include <atomic>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+
+namespace {
+
+std::atomic<std::size_t> numAllocations{0};
+std::atomic<std::ptrdiff_t> numLive{0};
+std::atomic<std::size_t> largestAllocation{0};
+
+// Counts what it allocates.
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    CountingAllocator() = default;
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U> &)
+    {
+    }
+
+    T * allocate(std::size_t n)
+    {
+        ++numAllocations;
+        ++numLive;
+        auto largest = largestAllocation.load();
+        while (largest < n * sizeof(T) &&
+                !largestAllocation.compare_exchange_weak(largest,
+                        n * sizeof(T))) {
+        }
+        return std::allocator<T>{}.allocate(n);
+    }
+
+    void deallocate(T *p, std::size_t n)
+    {
+        --numLive;
+        std::allocator<T>{}.deallocate(p, n);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const CountingAllocator<T> &, const CountingAllocator<U> &)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const CountingAllocator<T> &, const CountingAllocator<U> &)
+{
+    return false;
+}
+
+struct CountingPolicy : gungnir::DefaultTaskPoolPolicy {
+    using Allocator = CountingAllocator<char>;
+};
+
+// Also takes the queue blocks from the counting allocator.
+struct CountingQueuePolicy : CountingPolicy {
+    using QueueTraits = gungnir::CountingQueueTraits<Allocator>;
+
+    template <typename T>
+    using Queue = moodycamel::ConcurrentQueue<T, QueueTraits>;
+};
+
+struct RecyclingPolicy : gungnir::DefaultTaskPoolPolicy {
+    using Allocator = gungnir::RecyclingAllocator<char>;
+};
+
+}
+
+SCENARIO("a task pool allocates its bookkeeping with the policy's allocator",
+        "[allocator]") {
+
+    GIVEN("a task pool with a counting allocator") {
+
+        gungnir::BasicTaskPool<CountingPolicy> tp{2};
+        numAllocations = 0;
+
+        WHEN("tasks with results are dispatched") {
+
+            std::vector<std::future<int>> futures;
+            for (int i = 0; i < 100; ++i) {
+                futures.emplace_back(tp.dispatch<int>([i] { return i; }));
+            }
+            std::vector<gungnir::Task<int>> tasks(100, [] { return 1; });
+            auto serial = tp.dispatchSerial<int>(tasks.cbegin(), tasks.cend());
+
+            THEN("their promises and shared states come from it, and are "
+                    "given back") {
+
+                int sum = 0;
+                for (auto &f: futures) {
+                    sum += f.get();
+                }
+                for (auto &f: serial) {
+                    sum += f.get();
+                }
+                REQUIRE(sum == 99 * 100 / 2 + 100);
+                REQUIRE(numAllocations >= 2 * 100 + 100);
+
+                futures.clear();
+                serial.clear();
+                tp.shutdown();
+                REQUIRE(numLive == 0);
+            }
+        }
+
+        WHEN("a bulk of tasks with results is dispatched") {
+
+            largestAllocation = 0;
+            std::vector<gungnir::Task<int>> tasks(100, [] { return 1; });
+            auto bulk = tp.dispatchBulk<int>(tasks.cbegin(), tasks.cend());
+
+            THEN("the slots for their results come from it too") {
+
+                int sum = 0;
+                for (std::size_t i = 0; i < bulk.size(); ++i) {
+                    sum += bulk.get(i);
+                }
+                REQUIRE(sum == 100);
+                REQUIRE(largestAllocation >= 100 * sizeof(int));
+
+                bulk = gungnir::BulkFuture<int>{};
+                tp.shutdown();
+                REQUIRE(numLive == 0);
+            }
+        }
+
+        WHEN("a stream is mapped with many inputs in flight") {
+
+            largestAllocation = 0;
+            std::vector<int> inputs(1000, 1);
+            int sum = 0;
+            tp.mapBounded(inputs.cbegin(), inputs.cend(), 64,
+                    [](int x) { return x; },
+                    [&sum](int x) { sum += x; });
+
+            THEN("the slots for those inputs come from it too") {
+
+                REQUIRE(sum == 1000);
+                REQUIRE(largestAllocation >= 64 * 2 * sizeof(int));
+
+                tp.shutdown();
+                REQUIRE(numLive == 0);
+            }
+        }
+    }
+
+    GIVEN("a task pool with a recycling allocator") {
+
+        gungnir::BasicTaskPool<RecyclingPolicy> tp{4};
+
+        WHEN("several threads dispatch tasks with results") {
+
+            std::atomic<long> sum{0};
+            std::vector<std::thread> threads;
+            for (int t = 0; t < 4; ++t) {
+                threads.emplace_back([&tp, &sum] {
+                    for (int i = 0; i < 10000; ++i) {
+                        sum += tp.dispatch<int>([i] { return i; }).get();
+                    }
+                });
+            }
+            for (auto &t: threads) {
+                t.join();
+            }
+
+            THEN("every result arrives") {
+
+                REQUIRE(sum == 4L * 9999 * 10000 / 2);
+            }
+        }
+    }
+
+    GIVEN("a task pool whose queue blocks come from a counting allocator") {
+
+        const std::ptrdiff_t liveBefore = numLive;
+        std::ptrdiff_t liveWhileRunning = 0;
+        std::size_t queueBytes = 0;
+        std::atomic<int> x{0};
+        {
+            gungnir::BasicTaskPool<CountingQueuePolicy> tp{2};
+            const std::vector<gungnir::Task<void>> tasks(100000,
+                    [&x] { ++x; });
+            tp.dispatch(tasks.cbegin(), tasks.cend());
+            liveWhileRunning = numLive;
+            queueBytes = tp.stats().queueBytesRetained;
+            tp.shutdown();
+        }
+
+        THEN("they are allocated, counted and given back") {
+
+            REQUIRE(x == 100000);
+            REQUIRE(liveWhileRunning > liveBefore);
+            REQUIRE(queueBytes > 0);
+            REQUIRE(numLive == liveBefore);
+        }
+    }
+
+    GIVEN("a recycling allocator") {
+
+        gungnir::RecyclingAllocator<std::uint64_t> alloc;
+
+        WHEN("blocks are freed on another thread than they were allocated") {
+
+            std::vector<std::uint64_t *> blocks;
+            for (int i = 0; i < 1000; ++i) {
+                blocks.emplace_back(alloc.allocate(4));
+                *blocks.back() = i;
+            }
+            std::thread{[&] {
+                for (auto b: blocks) {
+                    alloc.deallocate(b, 4);
+                }
+            }}.join();
+
+            THEN("they can be allocated again, including large ones") {
+
+                for (int i = 0; i < 1000; ++i) {
+                    auto b = alloc.allocate(4);
+                    b[3] = i;
+                    alloc.deallocate(b, 4);
+                }
+                auto large = alloc.allocate(1000);
+                large[999] = 1;
+                alloc.deallocate(large, 1000);
+            }
+        }
+    }
+}
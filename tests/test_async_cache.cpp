@@ -0,0 +1,182 @@
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+#include "util.hpp"
+
+SCENARIO("an async cache loads values on the task pool", "[async_cache]") {
+
+    GIVEN("a task pool and a cache in front of a counting loader") {
+
+        gungnir::TaskPool tp{4};
+        std::atomic<int> numLoads{0};
+        gungnir::AsyncCacheOptions options;
+        options.capacity = 64;
+        gungnir::AsyncCache<int, int> cache{tp, [&numLoads](const int &k) {
+            ++numLoads;
+            return k * 2;
+        }, options};
+
+        WHEN("many threads miss the same key at once") {
+
+            std::promise<void> unblock;
+            std::shared_future<void> blocker{unblock.get_future()};
+            gungnir::AsyncCache<int, int> slow{tp,
+                [&numLoads, blocker](const int &k) {
+                    ++numLoads;
+                    blocker.wait();
+                    return k;
+                }};
+
+            std::vector<std::shared_future<int>> futures(100);
+            std::vector<std::thread> threads;
+            for (auto &f: futures) {
+                threads.emplace_back([&slow, &f] { f = slow.get(7); });
+            }
+            for (auto &t: threads) {
+                t.join();
+            }
+            unblock.set_value();
+
+            THEN("a single load runs, and everybody gets its value") {
+
+                for (auto &f: futures) {
+                    REQUIRE(f.get() == 7);
+                }
+                REQUIRE(numLoads == 1);
+                REQUIRE(slow.stats().misses == 1);
+                REQUIRE(slow.stats().hits == 99);
+            }
+        }
+
+        WHEN("more keys are loaded than fit") {
+
+            for (int k = 0; k < 1000; ++k) {
+                REQUIRE(cache.get(k).get() == k * 2);
+            }
+
+            THEN("entries are evicted to stay within the capacity") {
+
+                REQUIRE(cache.size() <= options.capacity);
+                REQUIRE(cache.stats().evictions >= 1000 - options.capacity);
+            }
+        }
+
+        WHEN("values are looked up without loading") {
+
+            int value = 0;
+            const auto before = cache.getIfPresent(1, value);
+            cache.get(1).wait();
+            const auto loaded = cache.getIfPresent(1, value);
+            cache.invalidate(1);
+            const auto invalidated = cache.getIfPresent(1, value);
+
+            THEN("only loaded values are returned") {
+
+                REQUIRE(!before);
+                REQUIRE(loaded);
+                REQUIRE(value == 2);
+                REQUIRE(!invalidated);
+                REQUIRE(cache.size() == 0);
+            }
+        }
+
+        WHEN("values are looked up right after their loads complete") {
+
+            int numPresent = 0;
+            for (int k = 0; k < 2000; ++k) {
+                cache.get(k).wait();
+                int value = 0;
+                if (cache.getIfPresent(k, value) && value == k * 2) {
+                    ++numPresent;
+                }
+            }
+
+            THEN("they are always found") {
+
+                REQUIRE(numPresent == 2000);
+            }
+        }
+    }
+
+    GIVEN("a cache whose entries expire") {
+
+        gungnir::TaskPool tp{2};
+        std::atomic<int> numLoads{0};
+        gungnir::AsyncCacheOptions options;
+        options.expireAfterWrite = std::chrono::milliseconds{30};
+        gungnir::AsyncCache<int, int, std::hash<int>,
+            gungnir::DefaultTaskPoolPolicy, ManualClock> cache{tp,
+            [&numLoads](const int &) { return ++numLoads; }, options};
+
+        WHEN("an entry is read before and after it expires") {
+
+            const auto first = cache.get(1).get();
+            const auto cached = cache.get(1).get();
+            ManualClock::advance(std::chrono::milliseconds{60});
+            const auto reloaded = cache.get(1).get();
+
+            THEN("it is loaded again once expired") {
+
+                REQUIRE(first == 1);
+                REQUIRE(cached == 1);
+                REQUIRE(reloaded == 2);
+            }
+        }
+    }
+
+    GIVEN("a cache whose entries are refreshed ahead") {
+
+        gungnir::TaskPool tp{2};
+        std::atomic<int> numLoads{0};
+        gungnir::AsyncCacheOptions options;
+        options.refreshAfterWrite = std::chrono::milliseconds{20};
+        gungnir::AsyncCache<int, int, std::hash<int>,
+            gungnir::DefaultTaskPoolPolicy, ManualClock> cache{tp,
+            [&numLoads](const int &) { return ++numLoads; }, options};
+
+        WHEN("an entry is read after it is due for a refresh") {
+
+            cache.get(1).wait();
+            ManualClock::advance(std::chrono::milliseconds{40});
+            const auto stale = cache.get(1).get();
+
+            THEN("the old value is returned while it reloads") {
+
+                REQUIRE(stale == 1);
+                REQUIRE(eventually([&] { return cache.get(1).get() == 2; }));
+                REQUIRE(cache.stats().refreshes >= 1);
+            }
+        }
+    }
+
+    GIVEN("a cache whose loader fails once") {
+
+        gungnir::TaskPool tp{2};
+        std::atomic<int> numLoads{0};
+        gungnir::AsyncCache<int, int> cache{tp, [&numLoads](const int &) {
+            if (++numLoads == 1) {
+                throw std::runtime_error{"load"};
+            }
+            return 42;
+        }};
+
+        WHEN("the key is asked for twice") {
+
+            auto failed = cache.get(1);
+
+            THEN("the failure is not kept") {
+
+                REQUIRE_THROWS_AS(failed.get(), const std::runtime_error &);
+                REQUIRE(cache.get(1).get() == 42);
+            }
+        }
+    }
+}
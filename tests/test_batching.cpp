@@ -0,0 +1,76 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+#include "util.hpp"
+
+SCENARIO("workers take tasks off the queue in batches", "[batching]") {
+
+    std::atomic<int> x{0};
+    std::vector<gungnir::Task<void>> tasks(1000, [&x] { ++x; });
+
+    GIVEN("a task pool whose workers take large batches") {
+
+        gungnir::TaskPoolOptions options;
+        options.minThreads = options.maxThreads = 4;
+        options.maxBatchSize = 64;
+        gungnir::TaskPool tp{options};
+
+        WHEN("many tiny tasks are dispatched") {
+
+            for (int i = 0; i < 10; ++i) {
+                tp.dispatch(tasks.cbegin(), tasks.cend());
+            }
+            for (const auto &t: tasks) {
+                tp.dispatch(t);
+            }
+            tp.shutdown();
+
+            THEN("every task is executed exactly once") {
+
+                REQUIRE(x == 11000);
+            }
+        }
+    }
+
+    GIVEN("a task pool whose only worker takes large batches") {
+
+        gungnir::TaskPoolOptions options;
+        options.minThreads = options.maxThreads = 1;
+        options.maxBatchSize = 64;
+        gungnir::TaskPool tp{options};
+
+        WHEN("it is shut down in the middle of a batch") {
+
+            // Batches double from one task up to 64, so the 101st task is
+            // in the middle of one; it holds the worker until the deadline
+            // of the shutdown has passed.
+            std::promise<void> started, unblock;
+            std::shared_future<void> blocker{unblock.get_future()};
+            std::vector<gungnir::Task<void>> batch(1000, [&x] { ++x; });
+            batch[100] = [&x, &started, blocker] {
+                started.set_value();
+                blocker.wait();
+                ++x;
+            };
+            tp.dispatch(batch.cbegin(), batch.cend());
+            started.get_future().wait();
+            const auto deadline = std::chrono::steady_clock::now();
+            auto t = onceShutDown(tp, [&unblock] { unblock.set_value(); });
+            auto unexecuted = tp.shutdown(deadline);
+            t.join();
+
+            THEN("the rest of the batch is returned with the queued tasks") {
+
+                REQUIRE(x >= 101);
+                REQUIRE(!unexecuted.empty());
+                REQUIRE(x + unexecuted.size() == 1000);
+            }
+        }
+    }
+}
@@ -0,0 +1,162 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+#include "util.hpp"
+
+SCENARIO("bulk dispatches share a single future", "[bulk_future]") {
+
+    GIVEN("a task pool") {
+
+        gungnir::TaskPool tp{4};
+
+        WHEN("a batch of tasks is dispatched in bulk") {
+
+            std::vector<gungnir::Task<std::string>> tasks;
+            for (int i = 0; i < 1000; ++i) {
+                tasks.emplace_back([i] { return std::to_string(i); });
+            }
+            auto results =
+                tp.dispatchBulk<std::string>(tasks.cbegin(), tasks.cend());
+
+            THEN("every result can be read by index") {
+
+                REQUIRE(results.size() == 1000);
+                results.wait();
+                REQUIRE(results.ready());
+                REQUIRE(results.numReady() == 1000);
+                for (std::size_t i = 0; i < results.size(); ++i) {
+                    REQUIRE(results[i] == std::to_string(i));
+                }
+                REQUIRE_THROWS_AS(results.get(1000),
+                        const std::out_of_range &);
+            }
+
+            THEN("iterating yields every index once, in completion order") {
+
+                std::set<std::size_t> seen;
+                for (auto i: results) {
+                    REQUIRE(results[i] == std::to_string(i));
+                    seen.insert(i);
+                }
+                REQUIRE(seen.size() == 1000);
+            }
+        }
+
+        WHEN("one task in a batch is slower than the others") {
+
+            std::promise<void> unblock;
+            std::shared_future<void> blocker{unblock.get_future()};
+            std::vector<gungnir::Task<int>> tasks(100, [] { return 1; });
+            tasks[0] = [blocker] {
+                blocker.wait();
+                return 0;
+            };
+            auto results = tp.dispatchBulk<int>(tasks.cbegin(), tasks.cend());
+
+            THEN("it comes last in completion order") {
+
+                auto it = results.begin();
+                for (int k = 0; k < 99; ++k, ++it) {
+                    REQUIRE(*it != 0);
+                }
+                REQUIRE(!results.waitFor(std::chrono::milliseconds{1}));
+                unblock.set_value();
+                REQUIRE(*it == 0);
+                REQUIRE(++it == results.end());
+            }
+        }
+
+        WHEN("a task in a batch throws") {
+
+            std::vector<gungnir::Task<int>> tasks(10, [] { return 1; });
+            tasks[3] = []() -> int { throw std::runtime_error{"oops"}; };
+            auto results = tp.dispatchBulk<int>(tasks.cbegin(), tasks.cend());
+
+            THEN("only its result rethrows the exception") {
+
+                REQUIRE(results[2] == 1);
+                REQUIRE_THROWS_AS(results[3], const std::runtime_error &);
+                REQUIRE(results[4] == 1);
+            }
+        }
+
+        WHEN("a batch of tasks is dispatched serially in bulk") {
+
+            std::atomic<int> next{0};
+            std::vector<gungnir::Task<int>> tasks(100, [&next] {
+                return next++;
+            });
+            auto results =
+                tp.dispatchSerialBulk<int>(tasks.cbegin(), tasks.cend());
+
+            THEN("they run and complete in order") {
+
+                std::size_t k = 0;
+                for (auto i: results) {
+                    REQUIRE(i == k);
+                    REQUIRE(results[i] == static_cast<int>(k));
+                    ++k;
+                }
+                REQUIRE(k == 100);
+            }
+        }
+
+        WHEN("an empty batch is dispatched in bulk") {
+
+            std::vector<gungnir::Task<int>> tasks;
+            auto results = tp.dispatchBulk<int>(tasks.cbegin(), tasks.cend());
+
+            THEN("its future is ready right away") {
+
+                REQUIRE(results.valid());
+                REQUIRE(results.ready());
+                REQUIRE(results.begin() == results.end());
+            }
+        }
+    }
+
+    GIVEN("a task pool whose only worker is busy") {
+
+        std::promise<void> started, unblock;
+        std::shared_future<void> blocker{unblock.get_future()};
+        gungnir::TaskPool tp{1};
+        tp.dispatch([&started, blocker] {
+            started.set_value();
+            blocker.wait();
+        });
+        started.get_future().wait();
+
+        WHEN("a batch dispatched in bulk is dropped by shutdownNow") {
+
+            std::vector<gungnir::Task<std::unique_ptr<int>>> tasks(10, [] {
+                return std::unique_ptr<int>{new int{42}};
+            });
+            auto results = tp.dispatchBulk<std::unique_ptr<int>>(
+                    tasks.cbegin(), tasks.cend());
+            auto t = onceShutDown(tp, [&unblock] { unblock.set_value(); });
+            auto unexecuted = tp.shutdownNow();
+            t.join();
+
+            THEN("running a returned task fills in its result, and dropping "
+                    "the others breaks their promises") {
+
+                REQUIRE(unexecuted.size() == 10);
+                unexecuted[0]();
+                unexecuted.clear();
+                REQUIRE(*results[0] == 42);
+                REQUIRE_THROWS_AS(results[1], const std::future_error &);
+                REQUIRE(results.ready());
+            }
+        }
+    }
+}
@@ -0,0 +1,234 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+
+#include "util.hpp"
+
+namespace {
+
+gungnir::TaskPoolOptions bounded(gungnir::RejectionPolicy policy)
+{
+    gungnir::TaskPoolOptions options;
+    options.minThreads = options.maxThreads = 1;
+    options.capacity = 4;
+    options.rejectionPolicy = policy;
+    return options;
+}
+
+}
+
+SCENARIO("a bounded task pool pushes back once its queue is full",
+        "[capacity]") {
+
+    std::atomic<int> x{0};
+    std::promise<void> started, unblock;
+    std::shared_future<void> blocker{unblock.get_future()};
+
+    // Keeps the only worker busy, and fills the queue behind it.
+    const auto fill = [&](gungnir::TaskPool &tp) {
+        tp.dispatch([&started, blocker] {
+            started.set_value();
+            blocker.wait();
+        });
+        started.get_future().wait();
+        for (int i = 0; i < 4; ++i) {
+            tp.dispatch([&x] { ++x; });
+        }
+    };
+
+    GIVEN("a full task pool that blocks dispatches") {
+
+        gungnir::TaskPool tp{bounded(gungnir::RejectionPolicy::Block)};
+        fill(tp);
+
+        WHEN("tasks are dispatched without waiting, or with a timeout") {
+
+            const bool dispatched = tp.tryDispatch([&x] { ++x; });
+            auto future = tp.tryDispatch<int>([] { return 42; });
+            const bool dispatchedFor = tp.dispatchFor(
+                    std::chrono::milliseconds{10}, [&x] { ++x; });
+
+            THEN("they are rejected") {
+
+                REQUIRE(!dispatched);
+                REQUIRE(!future.valid());
+                REQUIRE(!dispatchedFor);
+                REQUIRE(tp.stats().numRejected == 3);
+
+                unblock.set_value();
+                tp.shutdown();
+                REQUIRE(x == 4);
+            }
+        }
+
+        WHEN("a task is dispatched") {
+
+            std::atomic<bool> returned{false};
+            std::thread producer{[&tp, &x, &returned] {
+                tp.dispatch([&x] { ++x; });
+                returned = true;
+            }};
+            std::this_thread::sleep_for(std::chrono::milliseconds{20});
+            const bool returnedWhileFull = returned;
+            unblock.set_value();
+            producer.join();
+
+            THEN("dispatch waits until there is room") {
+
+                REQUIRE(!returnedWhileFull);
+                REQUIRE(returned);
+                tp.shutdown();
+                REQUIRE(x == 5);
+            }
+        }
+
+        WHEN("more tasks than fit are dispatched at once") {
+
+            std::vector<gungnir::Task<void>> tasks(100, [&x] { ++x; });
+            std::thread producer{[&tp, &tasks] {
+                tp.dispatch(tasks.cbegin(), tasks.cend());
+            }};
+            unblock.set_value();
+            producer.join();
+            tp.shutdown();
+
+            THEN("they are all executed in the end") {
+
+                REQUIRE(x == 104);
+            }
+        }
+    }
+
+    GIVEN("a full task pool that lets callers run what does not fit") {
+
+        gungnir::TaskPool tp{bounded(gungnir::RejectionPolicy::CallerRuns)};
+        fill(tp);
+
+        WHEN("tasks are dispatched") {
+
+            std::thread::id ranOn;
+            tp.dispatch([&ranOn] { ranOn = std::this_thread::get_id(); });
+            auto future = tp.dispatch<int>([] { return 42; });
+
+            THEN("they run on the dispatching thread") {
+
+                REQUIRE(ranOn == std::this_thread::get_id());
+                REQUIRE(future.wait_for(std::chrono::seconds{0}) ==
+                        std::future_status::ready);
+                REQUIRE(future.get() == 42);
+                REQUIRE(tp.stats().numCallerRuns == 2);
+                unblock.set_value();
+            }
+        }
+
+        WHEN("the pool shuts down while the dispatching thread runs a task") {
+
+            std::promise<void> shutDown;
+            auto done = shutDown.get_future();
+            auto t = onceShutDown(tp, [&unblock] { unblock.set_value(); });
+            std::thread shutter;
+            std::future_status status{};
+            tp.dispatch([&] {
+                shutter = std::thread{[&tp, &shutDown] {
+                    tp.shutdownNow();
+                    shutDown.set_value();
+                }};
+                status = done.wait_for(std::chrono::seconds{5});
+            });
+            shutter.join();
+            t.join();
+
+            THEN("the shutdown does not wait for that task") {
+
+                REQUIRE(status == std::future_status::ready);
+                REQUIRE_THROWS_AS(tp.dispatch([] {}), 
+                        const std::runtime_error &);
+            }
+        }
+    }
+
+    GIVEN("a full task pool that discards the oldest tasks") {
+
+        gungnir::TaskPoolOptions options =
+            bounded(gungnir::RejectionPolicy::DiscardOldest);
+        options.capacity = 1;
+        gungnir::TaskPool tp{options};
+        tp.dispatch([&started, blocker] {
+            started.set_value();
+            blocker.wait();
+        });
+        started.get_future().wait();
+
+        WHEN("tasks are dispatched") {
+
+            auto oldest = tp.dispatch<int>([] { return 1; });
+            auto newest = tp.dispatch<int>([] { return 2; });
+            unblock.set_value();
+
+            THEN("the oldest queued task makes room for the newest") {
+
+                REQUIRE_THROWS_AS(oldest.get(), const std::future_error &);
+                REQUIRE(newest.get() == 2);
+                REQUIRE(tp.stats().numDiscarded == 1);
+            }
+        }
+    }
+
+    GIVEN("a full task pool that throws") {
+
+        gungnir::TaskPool tp{bounded(gungnir::RejectionPolicy::Throw)};
+        fill(tp);
+
+        WHEN("a task is dispatched") {
+
+            THEN("dispatch throws") {
+
+                REQUIRE_THROWS_AS(tp.dispatch([] {}),
+                        const std::overflow_error &);
+                REQUIRE_THROWS_AS(tp.dispatch<int>([] { return 42; }),
+                        const std::overflow_error &);
+                REQUIRE(tp.stats().numRejected == 2);
+                unblock.set_value();
+            }
+        }
+    }
+
+    GIVEN("a task pool that throws once full, with room for a few tasks") {
+
+        gungnir::TaskPool tp{bounded(gungnir::RejectionPolicy::Throw)};
+        tp.dispatch([&started, blocker] {
+            started.set_value();
+            blocker.wait();
+        });
+        started.get_future().wait();
+
+        WHEN("more tasks are dispatched synchronously than fit") {
+
+            std::vector<gungnir::Task<void>> tasks(10, [&x] { ++x; });
+            // Only once the batch no longer fits may the worker make room.
+            std::thread t{[&tp, &unblock] {
+                while (tp.stats().numRejected == 0) {
+                    std::this_thread::yield();
+                }
+                unblock.set_value();
+            }};
+            const auto dispatchSync = [&] {
+                tp.dispatchSync(tasks.cbegin(), tasks.cend());
+            };
+
+            THEN("dispatchSync throws once the queued tasks are done") {
+
+                REQUIRE_THROWS_AS(dispatchSync(), const std::overflow_error &);
+                REQUIRE(x == 4);
+                t.join();
+            }
+        }
+    }
+}
@@ -0,0 +1,145 @@
+#include <chrono>
+#include <future>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+#include "util.hpp"
+
+SCENARIO("results can be taken in the order their tasks complete",
+        "[completion_queue]") {
+
+    GIVEN("a task pool and a completion queue") {
+
+        gungnir::TaskPool tp{4};
+        gungnir::CompletionQueue<int> completions;
+
+        WHEN("a batch of tasks is dispatched to the queue") {
+
+            std::vector<gungnir::Task<int>> tasks;
+            for (int i = 0; i < 1000; ++i) {
+                tasks.emplace_back([i] { return 2 * i; });
+            }
+            tp.dispatch(tasks.cbegin(), tasks.cend(), completions);
+
+            THEN("every result comes out once, under the index of its "
+                    "task") {
+
+                std::set<std::size_t> seen;
+                for (int i = 0; i < 1000; ++i) {
+                    auto c = completions.pop();
+                    REQUIRE(c.get() == 2 * static_cast<int>(c.index));
+                    seen.insert(c.index);
+                }
+                REQUIRE(seen.size() == 1000);
+
+                gungnir::CompletionQueue<int>::Completed c;
+                REQUIRE(!completions.tryPop(c));
+                REQUIRE(!completions.popFor(std::chrono::milliseconds{1}, c));
+            }
+
+            THEN("the results can be taken in bulk") {
+
+                std::vector<gungnir::CompletionQueue<int>::Completed> cs(64);
+                std::size_t total = 0;
+                while (total < 1000) {
+                    const auto n = completions.popBulk(cs.begin(), cs.size());
+                    REQUIRE(n > 0);
+                    REQUIRE(n <= cs.size());
+                    total += n;
+                }
+                REQUIRE(total == 1000);
+                REQUIRE(completions.tryPopBulk(cs.begin(), cs.size()) == 0);
+            }
+        }
+
+        WHEN("one task in a batch is slower than the others") {
+
+            std::promise<void> unblock;
+            std::shared_future<void> blocker{unblock.get_future()};
+            std::vector<gungnir::Task<int>> tasks(100, [] { return 1; });
+            tasks[0] = [blocker] {
+                blocker.wait();
+                return 0;
+            };
+            tp.dispatch(tasks.cbegin(), tasks.cend(), completions);
+
+            THEN("its result comes out last") {
+
+                for (int i = 0; i < 99; ++i) {
+                    REQUIRE(completions.pop().index != 0);
+                }
+                gungnir::CompletionQueue<int>::Completed c;
+                REQUIRE(!completions.popFor(std::chrono::milliseconds{1}, c));
+                unblock.set_value();
+                REQUIRE(completions.pop().index == 0);
+            }
+        }
+
+        WHEN("a task in a batch throws") {
+
+            std::vector<gungnir::Task<int>> tasks{
+                [] { return 1; },
+                []() -> int { throw std::runtime_error{"oops"}; }
+            };
+            tp.dispatch(tasks.cbegin(), tasks.cend(), completions);
+
+            THEN("its exception comes out under its index") {
+
+                for (int i = 0; i < 2; ++i) {
+                    auto c = completions.pop();
+                    if (c.index == 1) {
+                        REQUIRE_THROWS_AS(c.get(), const std::runtime_error &);
+                    } else {
+                        REQUIRE(c.get() == 1);
+                    }
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("dropped tasks still come out of a completion queue",
+        "[completion_queue]") {
+
+    GIVEN("a task pool whose only worker is busy") {
+
+        std::promise<void> started, unblock;
+        std::shared_future<void> blocker{unblock.get_future()};
+        gungnir::TaskPool tp{1};
+        tp.dispatch([&started, blocker] {
+            started.set_value();
+            blocker.wait();
+        });
+        started.get_future().wait();
+        gungnir::CompletionQueue<int> completions;
+
+        WHEN("a batch dispatched to the queue is dropped by shutdownNow") {
+
+            std::vector<gungnir::Task<int>> tasks(10, [] { return 1; });
+            tp.dispatch(tasks.cbegin(), tasks.cend(), completions);
+            auto t = onceShutDown(tp, [&unblock] { unblock.set_value(); });
+            // The returned tasks count as dropped once they are gone.
+            const auto numUnexecuted = tp.shutdownNow().size();
+            t.join();
+
+            THEN("every task comes out once, with a broken promise") {
+
+                REQUIRE(numUnexecuted == 10);
+                std::set<std::size_t> seen;
+                for (int i = 0; i < 10; ++i) {
+                    auto c = completions.pop();
+                    REQUIRE_THROWS_AS(c.get(), const std::future_error &);
+                    seen.insert(c.index);
+                }
+                REQUIRE(seen.size() == 10);
+                gungnir::CompletionQueue<int>::Completed c;
+                REQUIRE(!completions.tryPop(c));
+            }
+        }
+    }
+}
@@ -0,0 +1,152 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+#include "util.hpp"
+
+SCENARIO("an elastic task pool grows with load and shrinks when idle",
+        "[concurrency]") {
+
+    GIVEN("a task pool without any initial workers") {
+
+        gungnir::TaskPoolOptions options;
+        options.minThreads = 0;
+        options.maxThreads = 4;
+        options.idleTimeout = std::chrono::milliseconds{20};
+        gungnir::TaskPool tp{options};
+
+        REQUIRE(tp.numThreads() == 0);
+
+        WHEN("more blocking tasks are dispatched than it may have workers") {
+
+            std::atomic<int> numStarted{0};
+            std::atomic<int> numFinished{0};
+            std::promise<void> unblock;
+            std::shared_future<void> blocker{unblock.get_future()};
+
+            for (int i = 0; i < 8; ++i) {
+                tp.dispatch([&numStarted, &numFinished, blocker] {
+                    ++numStarted;
+                    blocker.wait();
+                    ++numFinished;
+                });
+            }
+
+            THEN("it grows to its maximum size, and retires the workers "
+                    "once they are idle") {
+
+                REQUIRE(eventually([&] { return numStarted == 4; }));
+                REQUIRE(tp.numThreads() == 4);
+
+                unblock.set_value();
+                REQUIRE(eventually([&] { return numFinished == 8; }));
+                REQUIRE(eventually([&] { return tp.numThreads() == 0; }));
+
+                // and comes back when needed
+                REQUIRE(tp.dispatch<int>([] { return 42; }).get() == 42);
+            }
+        }
+    }
+
+    GIVEN("a fixed-size task pool") {
+
+        gungnir::TaskPool tp{8};
+
+        REQUIRE(tp.numThreads() == 8);
+
+        WHEN("resized with setConcurrency") {
+
+            tp.setConcurrency(2);
+            const auto shrunk = tp.numThreads();
+            std::atomic<int> x{0};
+            for (int i = 0; i < 1000; ++i) {
+                tp.dispatch([&x] { ++x; });
+            }
+            tp.setConcurrency(6);
+            const auto grown = tp.numThreads();
+            for (int i = 0; i < 1000; ++i) {
+                tp.dispatch([&x] { ++x; });
+            }
+            tp.shutdown();
+
+            THEN("it runs every task with the new number of workers") {
+
+                REQUIRE(shrunk == 2);
+                REQUIRE(grown == 6);
+                REQUIRE(x == 2000);
+            }
+        }
+
+        WHEN("given invalid bounds") {
+
+            THEN("setConcurrency throws") {
+
+                REQUIRE_THROWS_AS(tp.setConcurrency(0),
+                        const std::invalid_argument &);
+                REQUIRE_THROWS_AS(tp.setConcurrency(4, 2),
+                        const std::invalid_argument &);
+            }
+        }
+    }
+}
+
+SCENARIO("the default concurrency honors the environment of the process",
+        "[concurrency]") {
+
+    GIVEN("the detected concurrency") {
+
+        const auto info = gungnir::detectConcurrency();
+
+        THEN("it is positive and explained") {
+
+            REQUIRE(info.concurrency > 0);
+            REQUIRE(info.concurrency <=
+                    std::max(1u, std::thread::hardware_concurrency()));
+            REQUIRE(!info.reason.empty());
+            REQUIRE(gungnir::TaskPool{}.numThreads() ==
+                    gungnir::defaultConcurrency().concurrency);
+        }
+    }
+
+#ifdef __unix__
+    GIVEN("an override in the environment") {
+
+        setenv("GUNGNIR_CONCURRENCY", "3", 1);
+        const auto info = gungnir::detectConcurrency();
+        unsetenv("GUNGNIR_CONCURRENCY");
+
+        THEN("the override wins") {
+
+            REQUIRE(info.concurrency == 3);
+            REQUIRE(info.source == gungnir::ConcurrencySource::Override);
+        }
+    }
+
+    GIVEN("overrides in the environment that are not positive numbers") {
+
+        const auto detected = gungnir::detectConcurrency();
+
+        THEN("they are ignored, and the detected concurrency is used") {
+
+            for (const char *value: {"-1", "0", "3x", " 3", "",
+                        "99999999999999999999999"}) {
+                setenv("GUNGNIR_CONCURRENCY", value, 1);
+                const auto info = gungnir::detectConcurrency();
+                unsetenv("GUNGNIR_CONCURRENCY");
+
+                REQUIRE(info.source != gungnir::ConcurrencySource::Override);
+                REQUIRE(info.concurrency == detected.concurrency);
+                REQUIRE(info.reason.find("ignored GUNGNIR_CONCURRENCY") !=
+                        std::string::npos);
+            }
+        }
+    }
+#endif
+}
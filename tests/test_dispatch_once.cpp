@@ -1,11 +1,15 @@
 #include <atomic>
+#include <chrono>
+#include <future>
 #include <mutex>
+#include <stdexcept>
 #include <thread>
 #include <vector>
 
 #include "gungnir/gungnir.hpp"
 
 #include "catch.hpp"
+#include "util.hpp"
 
 SCENARIO("dispatchOnce executes task exactly once, "
         "even if called from different threads", "[once]") {
@@ -36,3 +40,90 @@ SCENARIO("dispatchOnce executes task exactly once, "
         }
     }
 }
+
+SCENARIO("dispatchOnce with a gungnir::OnceFlag enqueues the task only once, "
+        "and reports when it is done", "[once]") {
+
+    GIVEN("a task pool and a flag") {
+
+        gungnir::TaskPool tp{8};
+        gungnir::OnceFlag flag;
+
+        REQUIRE(!flag.done());
+
+        WHEN("a task is passed to dispatchOnce from multiple threads") {
+
+            std::atomic<int> x{0};
+            std::vector<std::thread> threads;
+            for (int i = 0; i < 100; ++i) {
+                threads.emplace_back([&] {
+                    tp.dispatchOnce(flag, [&x] { x += 42; });
+                });
+            }
+            for (auto &t: threads) {
+                t.join();
+            }
+            flag.future().get();
+
+            THEN("the task gets executed exactly once") {
+
+                REQUIRE(flag.done());
+                REQUIRE(x == 42);
+            }
+
+            THEN("later calls return without dispatching, even once the "
+                    "pool is shut down") {
+
+                tp.shutdown();
+                tp.dispatchOnce(flag, [&x] { x += 42; });
+                REQUIRE(x == 42);
+            }
+        }
+
+        WHEN("the task throws") {
+
+            tp.dispatchOnce(flag, [] { throw std::runtime_error{"init"}; });
+
+            THEN("the future holds the exception, and the task is not "
+                    "retried") {
+
+                REQUIRE_THROWS_AS(flag.future().get(),
+                        const std::runtime_error &);
+                REQUIRE(flag.done());
+
+                std::atomic<int> x{0};
+                tp.dispatchOnce(flag, [&x] { ++x; });
+                tp.shutdown();
+                REQUIRE(x == 0);
+            }
+        }
+    }
+
+    GIVEN("a task pool whose only worker is busy") {
+
+        std::promise<void> started, unblock;
+        std::shared_future<void> blocker{unblock.get_future()};
+        gungnir::TaskPool tp{1};
+        tp.dispatch([&started, blocker] {
+            started.set_value();
+            blocker.wait();
+        });
+        started.get_future().wait();
+
+        WHEN("the task of a flag is dropped by shutdownNow") {
+
+            gungnir::OnceFlag flag;
+            tp.dispatchOnce(flag, [] {});
+            auto t = onceShutDown(tp, [&unblock] { unblock.set_value(); });
+            tp.shutdownNow();
+            t.join();
+
+            THEN("the flag completes with a broken promise") {
+
+                REQUIRE(flag.done());
+                REQUIRE_THROWS_AS(flag.future().get(),
+                        const std::future_error &);
+            }
+        }
+    }
+}
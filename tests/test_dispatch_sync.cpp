@@ -1,12 +1,43 @@
 #include <atomic>
+#include <chrono>
 #include <future>
+#include <memory>
 #include <numeric>
+#include <stdexcept>
 #include <thread>
 #include <vector>
 
 #include "gungnir/gungnir.hpp"
 
 #include "catch.hpp"
+#include "util.hpp"
+
+namespace {
+
+std::atomic<int> numCopies{0};
+
+struct Result {
+    Result() = default;
+    explicit Result(int value) : value{value} {}
+    Result(Result &&other) = default;
+    Result & operator=(Result &&other) = default;
+
+    Result(const Result &other) : value{other.value}
+    {
+        ++numCopies;
+    }
+
+    Result & operator=(const Result &other)
+    {
+        value = other.value;
+        ++numCopies;
+        return *this;
+    }
+
+    int value = 0;
+};
+
+}
 
 SCENARIO("dispatchSync waits for all tasks to finish", "[sync]") {
 
@@ -76,5 +107,131 @@ SCENARIO("dispatchSync waits for all tasks to finish", "[sync]") {
                 }
             }
         }
+
+        WHEN("passed to dispatchSync with storage for the results") {
+
+            std::vector<int> v(tasks.size());
+            tp.dispatchSync<int>(tasks.cbegin(), tasks.cend(), v.begin());
+
+            THEN("each result is stored in its place") {
+
+                for (std::size_t i = 0; i < v.size(); ++i) {
+                    REQUIRE(v[i] == static_cast<int>(i));
+                }
+            }
+        }
+    }
+
+    GIVEN("a collection of tasks that return values that are expensive to "
+            "copy or cannot be copied") {
+
+        std::vector<gungnir::Task<Result>> tasks;
+        std::vector<gungnir::Task<std::unique_ptr<int>>> moveOnlyTasks;
+        for (int i = 0; i < 100; ++i) {
+            tasks.emplace_back([i] { return Result{i}; });
+            moveOnlyTasks.emplace_back([i] {
+                return std::unique_ptr<int>{new int{i}};
+            });
+        }
+
+        WHEN("passed to dispatchSync with storage for the results") {
+
+            numCopies = 0;
+            std::vector<Result> results(tasks.size());
+            tp.dispatchSync<Result>(tasks.cbegin(), tasks.cend(),
+                    results.begin());
+            std::unique_ptr<int> moveOnlyResults[100];
+            tp.dispatchSync<std::unique_ptr<int>>(moveOnlyTasks.cbegin(),
+                    moveOnlyTasks.cend(), moveOnlyResults);
+
+            THEN("the results are moved into place, never copied") {
+
+                REQUIRE(numCopies == 0);
+                for (int i = 0; i < 100; ++i) {
+                    REQUIRE(results[i].value == i);
+                    REQUIRE(*moveOnlyResults[i] == i);
+                }
+            }
+        }
+    }
+
+    GIVEN("a collection of tasks one of which throws") {
+
+        std::atomic<int> count{0};
+        std::vector<gungnir::Task<int>> tasks(100, [&count] {
+            ++count;
+            return 1;
+        });
+        tasks[50] = []() -> int { throw std::runtime_error{"oops"}; };
+
+        WHEN("passed to dispatchSync with storage for the results") {
+
+            std::vector<int> v(tasks.size());
+
+            THEN("the exception is rethrown once the other tasks finished") {
+
+                REQUIRE_THROWS_AS(tp.dispatchSync<int>(tasks.cbegin(),
+                            tasks.cend(), v.begin()),
+                        const std::runtime_error &);
+                REQUIRE(count == 99);
+                REQUIRE(v[49] == 1);
+            }
+        }
+    }
+}
+
+SCENARIO("dispatchSync notices dropped tasks", "[sync]") {
+
+    GIVEN("a task pool whose only worker is busy") {
+
+        std::promise<void> started, unblock;
+        std::shared_future<void> blocker{unblock.get_future()};
+        gungnir::TaskPool tp{1};
+        tp.dispatch([&started, blocker] {
+            started.set_value();
+            blocker.wait();
+        });
+        started.get_future().wait();
+
+        WHEN("tasks without results are dropped by shutdownNow") {
+
+            std::vector<gungnir::Task<void>> tasks(10, [] {});
+            auto result = std::async(std::launch::async, [&] {
+                tp.dispatchSync(tasks.cbegin(), tasks.cend());
+            });
+            while (tp.stats().numQueued < 10) {
+                std::this_thread::yield();
+            }
+            auto t = onceShutDown(tp, [&unblock] { unblock.set_value(); });
+            // The returned tasks count as unexecuted once they are gone.
+            const auto numUnexecuted = tp.shutdownNow().size();
+            t.join();
+
+            THEN("dispatchSync throws a broken promise instead of waiting") {
+
+                REQUIRE(numUnexecuted == 10);
+                REQUIRE_THROWS_AS(result.get(), const std::future_error &);
+            }
+        }
+
+        WHEN("the tasks passed to dispatchSync are dropped by shutdownNow") {
+
+            std::vector<gungnir::Task<int>> tasks(10, [] { return 1; });
+            std::vector<int> v(tasks.size());
+            auto result = std::async(std::launch::async, [&] {
+                tp.dispatchSync<int>(tasks.cbegin(), tasks.cend(), v.begin());
+            });
+            while (tp.stats().numQueued < 10) {
+                std::this_thread::yield();
+            }
+            auto t = onceShutDown(tp, [&unblock] { unblock.set_value(); });
+            tp.shutdownNow();
+            t.join();
+
+            THEN("dispatchSync throws a broken promise") {
+
+                REQUIRE_THROWS_AS(result.get(), const std::future_error &);
+            }
+        }
     }
 }
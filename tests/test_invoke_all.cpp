@@ -0,0 +1,148 @@
+#include <atomic>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+
+SCENARIO("invokeAll runs callables in parallel and joins their results",
+        "[invoke_all]") {
+
+    GIVEN("a task pool") {
+
+        gungnir::TaskPool tp{4};
+
+        WHEN("callables with different results are invoked") {
+
+            auto results = tp.invokeAll(
+                    [] { return 42; },
+                    [] { return std::string{"answer"}; },
+                    [] { return std::unique_ptr<int>{new int{7}}; });
+
+            THEN("their results come back in a tuple") {
+
+                REQUIRE(std::get<0>(results) == 42);
+                REQUIRE(std::get<1>(results) == "answer");
+                REQUIRE(*std::get<2>(results) == 7);
+            }
+        }
+
+        WHEN("callables that return void are mixed with others") {
+
+            std::atomic<int> numRun{0};
+            auto results = tp.invokeAll(
+                    [&numRun] { ++numRun; },
+                    [&numRun] { ++numRun; return 42; },
+                    [&numRun] { ++numRun; });
+
+            THEN("they all run, and have no result in their place") {
+
+                REQUIRE(numRun == 3);
+                REQUIRE(std::get<1>(results) == 42);
+                const gungnir::NoResult none = std::get<0>(results);
+                (void)none;
+            }
+        }
+
+        WHEN("a callable that returns void throws") {
+
+            auto invoke = [&tp] {
+                tp.invokeAll([] { return 1; },
+                        [] { throw std::runtime_error{"void"}; });
+            };
+
+            THEN("its exception is rethrown") {
+
+                REQUIRE_THROWS_AS(invoke(), const std::runtime_error &);
+            }
+        }
+
+        WHEN("a single callable is invoked") {
+
+            const auto caller = std::this_thread::get_id();
+            auto results = tp.invokeAll([caller] {
+                return std::this_thread::get_id() == caller;
+            });
+
+            THEN("the calling thread runs it") {
+
+                REQUIRE(std::get<0>(results));
+            }
+        }
+
+        WHEN("some of the callables throw") {
+
+            std::atomic<int> numRun{0};
+            auto invoke = [&] {
+                tp.invokeAll(
+                        [&numRun] { ++numRun; return 1; },
+                        [&numRun]() -> int {
+                            ++numRun;
+                            throw std::runtime_error{"first"};
+                        },
+                        [&numRun]() -> int {
+                            ++numRun;
+                            throw std::logic_error{"second"};
+                        });
+            };
+
+            THEN("the first exception is rethrown once all of them ran") {
+
+                REQUIRE_THROWS_AS(invoke(), const std::runtime_error &);
+                REQUIRE(numRun == 3);
+            }
+        }
+
+        WHEN("invokeAll is nested in the tasks of every worker") {
+
+            std::vector<std::future<int>> futures;
+            for (int i = 0; i < 8; ++i) {
+                futures.emplace_back(tp.dispatch<int>([&tp] {
+                    auto r = tp.invokeAll(
+                            [&tp] {
+                                return std::get<0>(tp.invokeAll(
+                                            [] { return 1; },
+                                            [] { return 2; }));
+                            },
+                            [] { return 3; });
+                    return std::get<0>(r) + std::get<1>(r);
+                }));
+            }
+
+            THEN("it does not deadlock") {
+
+                for (auto &f: futures) {
+                    REQUIRE(f.get() == 4);
+                }
+            }
+        }
+    }
+
+    GIVEN("a task pool whose only worker is busy") {
+
+        std::promise<void> started, unblock;
+        std::shared_future<void> blocker{unblock.get_future()};
+        gungnir::TaskPool tp{1};
+        tp.dispatch([&started, blocker] {
+            started.set_value();
+            blocker.wait();
+        });
+        started.get_future().wait();
+
+        WHEN("callables are invoked") {
+
+            auto results = tp.invokeAll([] { return 1; }, [] { return 2; });
+            unblock.set_value();
+
+            THEN("the calling thread runs them all rather than waiting") {
+
+                REQUIRE(std::get<0>(results) + std::get<1>(results) == 3);
+            }
+        }
+    }
+}
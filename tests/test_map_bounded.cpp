@@ -0,0 +1,132 @@
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+
+SCENARIO("mapBounded maps a stream with a bounded number of inputs in flight",
+        "[map_bounded]") {
+
+    GIVEN("a task pool and a stream of words") {
+
+        gungnir::TaskPool tp{4};
+        std::ostringstream text;
+        for (int i = 0; i < 1000; ++i) {
+            text << i << ' ';
+        }
+        std::istringstream stream{text.str()};
+        std::istream_iterator<std::string> first{stream}, last;
+
+        WHEN("the words are mapped in completion order") {
+
+            std::atomic<int> inFlight{0};
+            std::atomic<int> maxInFlight{0};
+            std::vector<int> results;
+            tp.mapBounded(first, last, 8,
+                    [&](const std::string &word) {
+                        const auto n = ++inFlight;
+                        auto max = maxInFlight.load();
+                        while (n > max &&
+                                !maxInFlight.compare_exchange_weak(max, n)) {
+                        }
+                        const auto value = std::stoi(word);
+                        --inFlight;
+                        return value;
+                    },
+                    [&results](int value) { results.push_back(value); });
+
+            THEN("every result reaches the sink, with at most 8 in flight") {
+
+                REQUIRE(results.size() == 1000);
+                long sum = 0;
+                for (const auto r: results) {
+                    sum += r;
+                }
+                REQUIRE(sum == 999L * 1000 / 2);
+                REQUIRE(maxInFlight <= 8);
+            }
+        }
+
+        WHEN("the words are mapped in input order") {
+
+            std::vector<int> results;
+            tp.mapBounded(first, last, 8,
+                    [](const std::string &word) {
+                        const auto value = std::stoi(word);
+                        if (value % 7 == 0) {
+                            std::this_thread::sleep_for(
+                                    std::chrono::microseconds{100});
+                        }
+                        return value;
+                    },
+                    [&results](int value) { results.push_back(value); },
+                    gungnir::MapOrder::Input);
+
+            THEN("the sink gets the results in the order of the words") {
+
+                REQUIRE(results.size() == 1000);
+                bool ordered = true;
+                for (int i = 0; i < 1000; ++i) {
+                    ordered = ordered && results[i] == i;
+                }
+                REQUIRE(ordered);
+            }
+        }
+
+        WHEN("the function returns nothing") {
+
+            std::atomic<long> sum{0};
+            int numDone = 0;
+            tp.mapBounded(first, last, 8,
+                    [&sum](const std::string &word) { sum += std::stoi(word); },
+                    [&numDone] { ++numDone; },
+                    gungnir::MapOrder::Input);
+
+            THEN("the sink is called without arguments for every input") {
+
+                REQUIRE(numDone == 1000);
+                REQUIRE(sum == 999L * 1000 / 2);
+            }
+        }
+
+        WHEN("the function throws") {
+
+            std::atomic<int> numMapped{0};
+            auto map = [&] {
+                tp.mapBounded(first, last, 4,
+                        [&numMapped](const std::string &word) {
+                            ++numMapped;
+                            if (word == "100") {
+                                throw std::runtime_error{"map"};
+                            }
+                            return word.size();
+                        },
+                        [](std::size_t) {});
+            };
+
+            THEN("reading stops, and the exception is rethrown") {
+
+                REQUIRE_THROWS_AS(map(), const std::runtime_error &);
+                REQUIRE(numMapped < 1000);
+            }
+        }
+
+        WHEN("no inputs may be in flight") {
+
+            THEN("mapBounded throws") {
+
+                REQUIRE_THROWS_AS(tp.mapBounded(first, last, 0,
+                            [](const std::string &) { return 0; },
+                            [](int) {}),
+                        const std::invalid_argument &);
+            }
+        }
+    }
+}
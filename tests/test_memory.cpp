@@ -0,0 +1,88 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+#include "util.hpp"
+
+namespace {
+
+// Queues a burst of tasks behind a blocked worker, and lets it run them.
+void burst(gungnir::TaskPool &tp, std::atomic<int> &x, int numTasks)
+{
+    std::promise<void> unblock;
+    std::shared_future<void> blocker{unblock.get_future()};
+    tp.dispatch([blocker] { blocker.wait(); });
+    for (int i = 0; i < numTasks; ++i) {
+        tp.dispatch([&x] { ++x; });
+    }
+    unblock.set_value();
+}
+
+}
+
+SCENARIO("the queue gives memory back after a burst", "[memory]") {
+
+    std::atomic<int> x{0};
+
+    GIVEN("a task pool that has run a burst of tasks") {
+
+        gungnir::TaskPoolOptions options;
+        options.minThreads = options.maxThreads = 1;
+        gungnir::TaskPool tp{options};
+
+        burst(tp, x, 100000);
+        REQUIRE(eventually([&x] { return x == 100000; }));
+
+        const auto before = tp.stats();
+        REQUIRE(before.queueBytesRetained >
+                100000 * sizeof(gungnir::Task<void>));
+        REQUIRE(before.queueBytesInUse == 0);
+
+        WHEN("its memory is trimmed") {
+
+            const auto freed = tp.trimMemory();
+            const auto after = tp.stats();
+
+            THEN("the retained queue memory shrinks by what was freed") {
+
+                REQUIRE(freed > 0);
+                REQUIRE(after.queueBytesRetained ==
+                        before.queueBytesRetained - freed);
+                REQUIRE(after.queueBytesRetained <
+                        before.queueBytesRetained / 10);
+
+                // and the pool works as before
+                REQUIRE(tp.dispatch<int>([] { return 42; }).get() == 42);
+            }
+        }
+    }
+
+    GIVEN("a task pool that trims its memory when idle") {
+
+        gungnir::TaskPoolOptions options;
+        options.minThreads = options.maxThreads = 1;
+        options.trimIdleAfter = std::chrono::milliseconds{10};
+        gungnir::TaskPool tp{options};
+
+        const auto initial = tp.stats().queueBytesRetained;
+
+        WHEN("it runs a burst of tasks and then idles") {
+
+            burst(tp, x, 100000);
+
+            THEN("it gives the memory back by itself") {
+
+                REQUIRE(eventually([&x] { return x == 100000; }));
+                REQUIRE(eventually([&tp, initial] {
+                    return tp.stats().queueBytesRetained <
+                        initial + 100000 * sizeof(gungnir::Task<void>) / 10;
+                }));
+            }
+        }
+    }
+}
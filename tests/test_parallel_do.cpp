@@ -0,0 +1,167 @@
+#include <atomic>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+
+#include "util.hpp"
+
+SCENARIO("parallelDo processes initial and added items until none are left",
+        "[parallel_do]") {
+
+    GIVEN("a task pool") {
+
+        gungnir::TaskPool tp{4};
+
+        WHEN("a binary tree is walked from its root") {
+
+            std::atomic<int> numNodes{0};
+            std::atomic<long> sum{0};
+            const std::vector<int> roots{1};
+            tp.parallelDo(roots.begin(), roots.end(),
+                    [&](int node, gungnir::Feeder<int> &feeder) {
+                        ++numNodes;
+                        sum += node;
+                        if (node < (1 << 15)) {
+                            feeder.add(2 * node);
+                            feeder.add(2 * node + 1);
+                        }
+                    });
+
+            THEN("every node is visited exactly once") {
+
+                REQUIRE(numNodes == (1 << 16) - 1);
+                REQUIRE(sum == (1L << 16) * ((1 << 16) - 1) / 2);
+            }
+        }
+
+        WHEN("many initial items add a few items each") {
+
+            std::vector<int> items(1000, 3);
+            std::atomic<int> numProcessed{0};
+            tp.parallelDo(items.begin(), items.end(),
+                    [&numProcessed](int depth, gungnir::Feeder<int> &feeder) {
+                        ++numProcessed;
+                        if (depth > 0) {
+                            feeder.add(depth - 1);
+                        }
+                    });
+
+            THEN("all of them are processed") {
+
+                REQUIRE(numProcessed == 4000);
+            }
+        }
+
+        WHEN("the items are move-only") {
+
+            std::vector<std::unique_ptr<int>> items;
+            for (int i = 0; i < 100; ++i) {
+                items.emplace_back(new int{i});
+            }
+            std::atomic<int> sum{0};
+            tp.parallelDo(std::make_move_iterator(items.begin()),
+                    std::make_move_iterator(items.end()),
+                    [&sum](std::unique_ptr<int> &item,
+                        gungnir::Feeder<std::unique_ptr<int>> &feeder) {
+                        sum += *item;
+                        if (*item < 100) {
+                            feeder.add(std::unique_ptr<int>{
+                                    new int{*item + 100}});
+                        }
+                    });
+
+            THEN("they are moved through") {
+
+                REQUIRE(sum == 99 * 100 / 2 + (100 + 199) * 100 / 2);
+            }
+        }
+
+        WHEN("there are no items") {
+
+            const std::vector<int> items;
+            bool called = false;
+            tp.parallelDo(items.begin(), items.end(),
+                    [&called](int, gungnir::Feeder<int> &) { called = true; });
+
+            THEN("the body is never called") {
+
+                REQUIRE(!called);
+            }
+        }
+
+        WHEN("the body throws") {
+
+            std::atomic<int> numProcessed{0};
+            const std::vector<int> roots{0};
+            auto walk = [&] {
+                tp.parallelDo(roots.begin(), roots.end(),
+                        [&numProcessed](int i, gungnir::Feeder<int> &feeder) {
+                            if (++numProcessed == 100) {
+                                throw std::runtime_error{"body"};
+                            }
+                            feeder.add(i + 1);
+                        });
+            };
+
+            THEN("the walk stops and the exception is rethrown") {
+
+                REQUIRE_THROWS_AS(walk(), const std::runtime_error &);
+                REQUIRE(numProcessed == 100);
+            }
+        }
+    }
+
+    GIVEN("a task pool that shuts down in the middle of a parallelDo") {
+
+        gungnir::TaskPool tp{2};
+        std::promise<void> started, inBody, unblock;
+        std::shared_future<void> blocker{unblock.get_future()};
+        tp.dispatch([&started, blocker] {
+            started.set_value();
+            blocker.wait();
+        });
+        started.get_future().wait();
+
+        WHEN("a chunk is dropped without running") {
+
+            // One chunk runs on the free worker until the shutdown, while
+            // the other waits in the queue behind the busy worker.
+            std::atomic<bool> blocked{false};
+            std::atomic<int> numProcessed{0};
+            const std::vector<int> items(100);
+            std::size_t numDropped = 0;
+            std::thread shutter{[&] {
+                inBody.get_future().wait();
+                eventually([&tp] { return tp.stats().numQueued == 1; });
+                numDropped = tp.shutdownNow().size();
+            }};
+            auto t = onceShutDown(tp, [&unblock] { unblock.set_value(); });
+            auto walk = [&] {
+                tp.parallelDo(items.begin(), items.end(),
+                        [&](int, gungnir::Feeder<int> &) {
+                            if (!blocked.exchange(true)) {
+                                inBody.set_value();
+                                blocker.wait();
+                            }
+                            ++numProcessed;
+                        });
+            };
+
+            THEN("parallelDo returns once the other chunk is done") {
+
+                REQUIRE_THROWS_AS(walk(), const std::future_error &);
+                shutter.join();
+                t.join();
+                REQUIRE(numDropped == 1);
+                REQUIRE(numProcessed == 50);
+            }
+        }
+    }
+}
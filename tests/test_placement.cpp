@@ -0,0 +1,119 @@
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+
+SCENARIO("workers are placed on CPUs and NUMA nodes", "[placement]") {
+
+    GIVEN("the NUMA topology") {
+
+        const auto nodes = gungnir::numaTopology();
+
+        THEN("every node has CPUs to run on") {
+
+            REQUIRE(!nodes.empty());
+            for (const auto &node: nodes) {
+                REQUIRE(!node.cpus.empty());
+            }
+        }
+    }
+
+    GIVEN("a task pool with one sub-pool per NUMA node") {
+
+        gungnir::TaskPoolOptions options;
+        options.minThreads = options.maxThreads = 4;
+        options.placement = gungnir::Placement::PerNode;
+        gungnir::TaskPool tp{options};
+
+        WHEN("tasks are dispatched to each node") {
+
+            std::vector<std::future<int>> futures;
+            for (std::size_t i = 0; i < tp.nodes().size(); ++i) {
+                for (int j = 0; j < 100; ++j) {
+                    futures.emplace_back(tp.dispatchOnNode<int>(i,
+                                [j] { return j; }));
+                }
+            }
+
+            THEN("they are all executed") {
+
+                int sum = 0;
+                for (auto &f: futures) {
+                    sum += f.get();
+                }
+                REQUIRE(sum == static_cast<int>(tp.nodes().size()) *
+                        (0 + 99) * 100 / 2);
+            }
+        }
+
+        WHEN("a task is dispatched to a node that does not exist") {
+
+            THEN("dispatchOnNode throws") {
+
+                REQUIRE_THROWS_AS(tp.dispatchOnNode(tp.nodes().size(), [] {}),
+                        const std::out_of_range &);
+            }
+        }
+    }
+
+    GIVEN("explicit CPUs the process may not run on") {
+
+        gungnir::TaskPoolOptions options;
+        options.minThreads = options.maxThreads = 2;
+        options.placement = gungnir::Placement::Explicit;
+
+        THEN("the task pool refuses them") {
+
+            const int valid = gungnir::numaTopology().front().cpus.front();
+            for (const int invalid: {-1, 1 << 20}) {
+                options.cpus = {valid, invalid};
+                REQUIRE_THROWS_AS(gungnir::TaskPool{options},
+                        const std::invalid_argument &);
+            }
+            options.cpus.clear();
+            REQUIRE_THROWS_AS(gungnir::TaskPool{options},
+                    const std::invalid_argument &);
+        }
+    }
+
+#ifdef __linux__
+    GIVEN("a task pool whose workers are pinned to an explicit CPU") {
+
+        const int cpu = gungnir::numaTopology().front().cpus.front();
+
+        gungnir::TaskPoolOptions options;
+        options.minThreads = options.maxThreads = 2;
+        options.placement = gungnir::Placement::Explicit;
+        options.cpus = {cpu};
+        gungnir::TaskPool tp{options};
+
+        WHEN("tasks run") {
+
+            std::atomic<bool> pinned{true};
+            std::vector<gungnir::Task<void>> tasks(100, [cpu, &pinned] {
+                cpu_set_t cpus;
+                CPU_ZERO(&cpus);
+                sched_getaffinity(0, sizeof(cpus), &cpus);
+                if (CPU_COUNT(&cpus) != 1 || !CPU_ISSET(cpu, &cpus) ||
+                        sched_getcpu() != cpu) {
+                    pinned = false;
+                }
+            });
+            tp.dispatchSync(tasks.cbegin(), tasks.cend());
+
+            THEN("they run on that CPU only") {
+
+                REQUIRE(pinned);
+            }
+        }
+    }
+#endif
+}
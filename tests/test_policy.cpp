@@ -0,0 +1,67 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+
+namespace {
+
+// What a latency-critical path might use: busy-polling workers, no
+// statistics beyond the basics, and larger queue blocks.
+struct LowLatencyPolicy : gungnir::DefaultTaskPoolPolicy {
+    struct QueueTraits : moodycamel::ConcurrentQueueDefaultTraits {
+        static const std::size_t BLOCK_SIZE = 256;
+    };
+
+    template <typename T>
+    using Queue = moodycamel::ConcurrentQueue<T, QueueTraits>;
+
+    using IdleWait = gungnir::FixedIdleWait<gungnir::WaitStrategy::BusyPoll>;
+
+    static constexpr gungnir::Instrumentation instrumentation =
+        gungnir::Instrumentation::Minimal;
+};
+
+}
+
+SCENARIO("task pools are configured at compile time with a policy",
+        "[policy]") {
+
+    GIVEN("a task pool with a custom policy") {
+
+        gungnir::BasicTaskPool<LowLatencyPolicy> tp{2};
+
+        WHEN("tasks are dispatched") {
+
+            std::atomic<int> x{0};
+            std::vector<gungnir::Task<void>> tasks(1000, [&x] { ++x; });
+            tp.dispatch(tasks.cbegin(), tasks.cend());
+            auto future = tp.dispatch<int>([] { return 42; });
+            tp.dispatchSync(tasks.cbegin(), tasks.cend());
+
+            THEN("they are executed as with the default policy") {
+
+                REQUIRE(future.get() == 42);
+                REQUIRE(x == 2000);
+                REQUIRE(tp.stats().numSleeps == 0);
+            }
+        }
+
+        WHEN("options that need full instrumentation are given") {
+
+            gungnir::TaskPoolOptions options;
+            options.sheddingTarget = std::chrono::milliseconds{1};
+
+            THEN("the constructor throws") {
+
+                REQUIRE_THROWS_AS(
+                        gungnir::BasicTaskPool<LowLatencyPolicy>{options},
+                        const std::invalid_argument &);
+            }
+        }
+    }
+}
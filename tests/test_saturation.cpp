@@ -0,0 +1,110 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+
+SCENARIO("a saturated task pool lets callers run their own tasks",
+        "[saturation]") {
+
+    GIVEN("a task pool whose only worker is busy") {
+
+        std::atomic<int> x{0};
+        std::promise<void> started, unblock;
+        std::shared_future<void> blocker{unblock.get_future()};
+
+        gungnir::TaskPoolOptions options;
+        options.minThreads = options.maxThreads = 1;
+        options.saturationQueueDepth = 2;
+        gungnir::TaskPool tp{options};
+        tp.dispatch([&started, blocker] {
+            started.set_value();
+            blocker.wait();
+        });
+        started.get_future().wait();
+
+        WHEN("no more tasks are queued than the saturation threshold") {
+
+            const bool ranOnCaller = tp.dispatchOrRun([&x] { ++x; });
+            auto future = tp.dispatchOrRun<int>([] { return 42; });
+
+            THEN("the tasks are queued") {
+
+                REQUIRE(!tp.saturated());
+                REQUIRE(!ranOnCaller);
+                REQUIRE(future.wait_for(std::chrono::seconds{0}) ==
+                        std::future_status::timeout);
+
+                unblock.set_value();
+                REQUIRE(future.get() == 42);
+                REQUIRE(tp.stats().numSaturatedRuns == 0);
+            }
+        }
+
+        WHEN("more tasks are queued than the saturation threshold") {
+
+            for (int i = 0; i < 3; ++i) {
+                tp.dispatch([&x] { ++x; });
+            }
+            std::thread::id ranOn;
+            const bool ranOnCaller = tp.dispatchOrRun([&ranOn] {
+                ranOn = std::this_thread::get_id();
+            });
+            auto future = tp.dispatchOrRun<int>([] { return 42; });
+            unblock.set_value();
+
+            THEN("the tasks run on the calling thread") {
+
+                REQUIRE(ranOnCaller);
+                REQUIRE(ranOn == std::this_thread::get_id());
+                REQUIRE(future.wait_for(std::chrono::seconds{0}) ==
+                        std::future_status::ready);
+                REQUIRE(future.get() == 42);
+                REQUIRE(tp.stats().numSaturatedRuns == 2);
+                REQUIRE(tp.stats().numCallerRuns == 2);
+            }
+        }
+
+        WHEN("the saturated pool is being shut down") {
+
+            for (int i = 0; i < 3; ++i) {
+                tp.dispatch([&x] { ++x; });
+            }
+            std::thread t{[&tp] { tp.shutdown(); }};
+            for (;;) {
+                try {
+                    tp.dispatch([] {});
+                } catch (const std::runtime_error &) {
+                    break;
+                }
+                std::this_thread::yield();
+            }
+            std::atomic<bool> ran{false};
+            auto dispatchOrRun = [&] {
+                tp.dispatchOrRun([&ran] { ran = true; });
+            };
+            auto dispatchOrRunResult = [&] {
+                tp.dispatchOrRun<int>([&ran] { ran = true; return 1; });
+            };
+
+            THEN("dispatchOrRun throws instead of running the tasks") {
+
+                REQUIRE(tp.saturated());
+                REQUIRE_THROWS_AS(dispatchOrRun(),
+                        const std::runtime_error &);
+                REQUIRE_THROWS_AS(dispatchOrRunResult(),
+                        const std::runtime_error &);
+                REQUIRE(!ran);
+                REQUIRE(tp.stats().numSaturatedRuns == 0);
+
+                unblock.set_value();
+                t.join();
+                REQUIRE(x == 3);
+            }
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+#include "util.hpp"
+
+SCENARIO("an overloaded task pool sheds low-priority dispatches",
+        "[shedding]") {
+
+    GIVEN("a task pool that sheds load once tasks queue for too long") {
+
+        std::mutex m;
+        std::vector<bool> reports;
+
+        gungnir::TaskPoolOptions options;
+        options.minThreads = options.maxThreads = 1;
+        options.sheddingTarget = std::chrono::milliseconds{1};
+        options.sheddingInterval = std::chrono::milliseconds{5};
+        options.onOverload = [&m, &reports](bool overloaded,
+                std::chrono::microseconds) {
+            std::lock_guard<std::mutex> lk{m};
+            reports.emplace_back(overloaded);
+        };
+        gungnir::TaskPool tp{options};
+
+        WHEN("tasks arrive faster than they are executed") {
+
+            std::atomic<int> x{0};
+            for (int i = 0; i < 50; ++i) {
+                tp.dispatch([&x] {
+                    std::this_thread::sleep_for(std::chrono::milliseconds{2});
+                    ++x;
+                });
+            }
+
+            THEN("low-priority tasks are shed until the queue drains") {
+
+                REQUIRE(eventually([&tp] { return tp.stats().overloaded; }));
+
+                REQUIRE(!tp.dispatch(gungnir::Priority::Low, [&x] { ++x; }));
+                REQUIRE(!tp.dispatch<int>(gungnir::Priority::Low,
+                            [] { return 42; }).valid());
+                REQUIRE(tp.dispatch(gungnir::Priority::Normal, [&x] { ++x; }));
+                REQUIRE(tp.stats().numShed == 2);
+
+                REQUIRE(eventually([&tp] { return !tp.stats().overloaded; }));
+                REQUIRE(x == 51);
+                REQUIRE(tp.dispatch<int>(gungnir::Priority::Low,
+                            [] { return 42; }).get() == 42);
+
+                std::lock_guard<std::mutex> lk{m};
+                REQUIRE(reports == (std::vector<bool>{true, false}));
+            }
+        }
+    }
+}
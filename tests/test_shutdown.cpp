@@ -0,0 +1,148 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+#include "util.hpp"
+
+SCENARIO("shutdown stops the task pool in the requested way", "[shutdown]") {
+
+    GIVEN("a task pool whose only worker is busy") {
+
+        std::atomic<int> x{0};
+        std::promise<void> started, unblock;
+        std::shared_future<void> blocker{unblock.get_future()};
+
+        gungnir::TaskPool tp{1};
+        tp.dispatch([&started, blocker] {
+            started.set_value();
+            blocker.wait();
+        });
+        started.get_future().wait();
+        for (int i = 0; i < 100; ++i) {
+            tp.dispatch([&x] { ++x; });
+        }
+
+        WHEN("shut down with ShutdownMode::Drain") {
+
+            auto t = onceShutDown(tp, [&unblock] { unblock.set_value(); });
+            auto unexecuted = tp.shutdown(gungnir::ShutdownMode::Drain);
+            t.join();
+
+            THEN("every queued task is executed") {
+
+                REQUIRE(unexecuted.empty());
+                REQUIRE(x == 100);
+            }
+        }
+
+        WHEN("shut down with shutdownNow") {
+
+            auto t = onceShutDown(tp, [&unblock] { unblock.set_value(); });
+            auto unexecuted = tp.shutdownNow();
+            t.join();
+
+            THEN("the queued tasks are returned instead of executed") {
+
+                REQUIRE(x == 0);
+                REQUIRE(unexecuted.size() == 100);
+
+                for (auto &task: unexecuted) {
+                    task();
+                }
+                REQUIRE(x == 100);
+            }
+        }
+
+        WHEN("shut down with a deadline that passes while the worker is busy") {
+
+            const auto deadline = std::chrono::steady_clock::now() +
+                std::chrono::milliseconds{10};
+            auto t = onceShutDown(tp, [&unblock, deadline] {
+                std::this_thread::sleep_until(deadline);
+                unblock.set_value();
+            });
+            auto unexecuted = tp.shutdown(deadline);
+            t.join();
+
+            THEN("the tasks not started by the deadline are returned") {
+
+                REQUIRE(x == 0);
+                REQUIRE(unexecuted.size() == 100);
+            }
+        }
+
+        WHEN("shut down with the last deadline of another clock") {
+
+            auto t = onceShutDown(tp, [&unblock] { unblock.set_value(); });
+            const auto unexecuted = tp.shutdown(
+                    std::chrono::system_clock::time_point::max());
+            t.join();
+
+            THEN("the deadline never passes, and every task runs") {
+
+                REQUIRE(unexecuted.empty());
+                REQUIRE(x == 100);
+            }
+        }
+
+        WHEN("shut down with the last deadline of a coarse clock") {
+
+            using Hours = std::chrono::time_point<std::chrono::system_clock,
+                  std::chrono::hours>;
+            auto t = onceShutDown(tp, [&unblock] { unblock.set_value(); });
+            const auto unexecuted = tp.shutdown(Hours::max());
+            t.join();
+
+            THEN("the deadline never passes, and every task runs") {
+
+                REQUIRE(unexecuted.empty());
+                REQUIRE(x == 100);
+            }
+        }
+
+        WHEN("dispatched to after being shut down") {
+
+            unblock.set_value();
+            tp.shutdown();
+
+            THEN("dispatch throws and shutdown is a no-op") {
+
+                REQUIRE_THROWS_AS(tp.dispatch([] {}),
+                        const std::runtime_error &);
+                REQUIRE_THROWS_AS(tp.dispatch<int>([] { return 42; }),
+                        const std::runtime_error &);
+                REQUIRE(tp.shutdownNow().empty());
+                REQUIRE(x == 100);
+            }
+        }
+    }
+
+    GIVEN("tasks that dispatch follow-up tasks") {
+
+        std::atomic<int> x{0};
+
+        WHEN("the task pool is drained") {
+
+            {
+                gungnir::TaskPool tp{4};
+                for (int i = 0; i < 100; ++i) {
+                    tp.dispatch([&tp, &x] {
+                        tp.dispatch([&x] { ++x; });
+                    });
+                }
+                tp.shutdown();
+            }
+
+            THEN("the follow-up tasks are executed as well") {
+
+                REQUIRE(x == 100);
+            }
+        }
+    }
+}
@@ -0,0 +1,147 @@
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+#include "util.hpp"
+
+SCENARIO("singleFlight runs one load per key for concurrent callers",
+        "[single_flight]") {
+
+    GIVEN("a task pool and a group without retention") {
+
+        gungnir::TaskPool tp{4};
+        gungnir::SingleFlight<std::string, int> group;
+        std::atomic<int> numLoads{0};
+
+        WHEN("many threads ask for the same key while it loads") {
+
+            std::promise<void> unblock;
+            std::shared_future<void> blocker{unblock.get_future()};
+            auto loader = [&numLoads, blocker] {
+                ++numLoads;
+                blocker.wait();
+                return 42;
+            };
+
+            std::vector<std::shared_future<int>> futures(100);
+            std::vector<std::thread> threads;
+            for (auto &f: futures) {
+                threads.emplace_back([&tp, &group, &loader, &f] {
+                    f = tp.singleFlight(group, std::string{"key"}, loader);
+                });
+            }
+            for (auto &t: threads) {
+                t.join();
+            }
+            const auto inFlight = group.size();
+            unblock.set_value();
+
+            THEN("a single load runs, and every caller gets its result") {
+
+                for (auto &f: futures) {
+                    REQUIRE(f.get() == 42);
+                }
+                REQUIRE(numLoads == 1);
+                REQUIRE(inFlight == 1);
+                REQUIRE(group.size() == 0);
+            }
+        }
+
+        WHEN("different keys are asked for") {
+
+            auto a = tp.singleFlight(group, std::string{"a"},
+                    [&numLoads] { ++numLoads; return 1; });
+            auto b = tp.singleFlight(group, std::string{"b"},
+                    [&numLoads] { ++numLoads; return 2; });
+
+            THEN("each key gets its own load") {
+
+                REQUIRE(a.get() == 1);
+                REQUIRE(b.get() == 2);
+                REQUIRE(numLoads == 2);
+            }
+        }
+
+        WHEN("a key is asked for again after its load completed") {
+
+            auto loader = [&numLoads] { return ++numLoads; };
+            tp.singleFlight(group, std::string{"key"}, loader).get();
+            const auto again =
+                tp.singleFlight(group, std::string{"key"}, loader).get();
+
+            THEN("it is loaded again") {
+
+                REQUIRE(again == 2);
+            }
+        }
+
+        WHEN("the load throws") {
+
+            auto f = tp.singleFlight(group, std::string{"key"},
+                    []() -> int { throw std::runtime_error{"load"}; });
+
+            THEN("its callers get the exception") {
+
+                REQUIRE_THROWS_AS(f.get(), const std::runtime_error &);
+            }
+        }
+    }
+
+    GIVEN("a task pool and a group that keeps results for a while") {
+
+        gungnir::TaskPool tp{2};
+        gungnir::SingleFlight<int, int, std::hash<int>, ManualClock> group{
+            std::chrono::milliseconds{50}};
+        std::atomic<int> numLoads{0};
+        auto loader = [&numLoads] { return ++numLoads; };
+
+        WHEN("a key is asked for again within the TTL") {
+
+            tp.singleFlight(group, 1, loader).get();
+            const auto again = tp.singleFlight(group, 1, loader).get();
+
+            THEN("the kept result is reused") {
+
+                REQUIRE(again == 1);
+                REQUIRE(numLoads == 1);
+                REQUIRE(group.size() == 1);
+            }
+        }
+
+        WHEN("a key is asked for again after the TTL, or after forget") {
+
+            tp.singleFlight(group, 1, loader).get();
+            ManualClock::advance(std::chrono::milliseconds{100});
+            const auto expired = tp.singleFlight(group, 1, loader).get();
+            group.forget(1);
+            const auto forgotten = tp.singleFlight(group, 1, loader).get();
+
+            THEN("it is loaded again") {
+
+                REQUIRE(expired == 2);
+                REQUIRE(forgotten == 3);
+            }
+        }
+
+        WHEN("the load throws") {
+
+            tp.singleFlight(group, 1, []() -> int {
+                throw std::runtime_error{"load"};
+            }).wait();
+            const auto again = tp.singleFlight(group, 1, loader).get();
+
+            THEN("the failure is not kept") {
+
+                REQUIRE(again == 1);
+            }
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+#include "util.hpp"
+
+SCENARIO("dispatches only wake up workers that are asleep", "[stats]") {
+
+    std::atomic<int> x{0};
+    std::vector<gungnir::Task<void>> tasks(100, [&x] { ++x; });
+
+    GIVEN("a task pool whose workers are all asleep") {
+
+        gungnir::TaskPoolOptions options;
+        options.minThreads = options.maxThreads = 4;
+        options.waitStrategy = gungnir::WaitStrategy::Block;
+        gungnir::TaskPool tp{options};
+
+        REQUIRE(eventually([&tp] { return tp.stats().numIdle == 4; }));
+        const auto before = tp.stats();
+        REQUIRE(before.numSleeps >= 4);
+
+        WHEN("a batch of tasks is dispatched") {
+
+            tp.dispatch(tasks.cbegin(), tasks.cend());
+
+            THEN("a single wake-up is issued for the whole batch") {
+
+                REQUIRE(tp.stats().numWakes - before.numWakes == 1);
+                tp.shutdown();
+                REQUIRE(x == 100);
+            }
+        }
+    }
+
+    GIVEN("a task pool whose workers never sleep") {
+
+        gungnir::TaskPoolOptions options;
+        options.minThreads = options.maxThreads = 2;
+        options.waitStrategy = gungnir::WaitStrategy::Yield;
+        gungnir::TaskPool tp{options};
+
+        WHEN("tasks are dispatched one by one") {
+
+            for (const auto &t: tasks) {
+                tp.dispatch(t);
+            }
+            tp.shutdown();
+
+            THEN("no wake-up is ever issued") {
+
+                REQUIRE(x == 100);
+                REQUIRE(tp.stats().numSleeps == 0);
+                REQUIRE(tp.stats().numWakes == 0);
+                REQUIRE(tp.stats().numQueued == 0);
+            }
+        }
+    }
+}
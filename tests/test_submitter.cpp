@@ -0,0 +1,64 @@
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+
+SCENARIO("submitters dispatch through sub-queues of their own",
+        "[submitter]") {
+
+    GIVEN("a task pool and several producer threads") {
+
+        gungnir::TaskPool tp{4};
+        std::atomic<int> x{0};
+        std::atomic<int> sum{0};
+
+        WHEN("each producer dispatches through a submitter") {
+
+            std::vector<std::thread> producers;
+            for (int i = 0; i < 4; ++i) {
+                producers.emplace_back([&tp, &x, &sum] {
+                    auto submitter = tp.submitter();
+
+                    std::vector<gungnir::Task<void>> tasks(100, [&x] { ++x; });
+                    submitter.dispatch(tasks.cbegin(), tasks.cend());
+
+                    std::vector<std::future<int>> futures;
+                    for (int j = 0; j < 100; ++j) {
+                        submitter.dispatch([&x] { ++x; });
+                        futures.emplace_back(
+                                submitter.dispatch<int>([j] { return j; }));
+                    }
+                    for (auto &f: futures) {
+                        sum += f.get();
+                    }
+                });
+            }
+            for (auto &p: producers) {
+                p.join();
+            }
+            tp.shutdown();
+
+            THEN("every task is executed") {
+
+                REQUIRE(x == 4 * 200);
+                REQUIRE(sum == 4 * (0 + 99) * 100 / 2);
+            }
+        }
+
+        WHEN("the pool is shut down") {
+
+            auto submitter = tp.submitter();
+            tp.shutdown();
+
+            THEN("dispatching through a submitter throws") {
+
+                REQUIRE_THROWS_AS(submitter.dispatch([] {}),
+                        const std::runtime_error &);
+            }
+        }
+    }
+}
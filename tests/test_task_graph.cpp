@@ -0,0 +1,168 @@
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+
+SCENARIO("a task graph runs every node after its predecessors",
+        "[task_graph]") {
+
+    GIVEN("a task pool and a diamond-shaped graph") {
+
+        gungnir::TaskPool tp{4};
+        std::atomic<int> clock{0};
+        std::vector<int> stamps(4);
+        gungnir::TaskGraph graph;
+        std::vector<gungnir::TaskGraph::Node> nodes;
+        for (int i = 0; i < 4; ++i) {
+            nodes.push_back(graph.add([&clock, &stamps, i] {
+                stamps[i] = ++clock;
+            }));
+        }
+        graph.precede(nodes[0], nodes[1]);
+        graph.precede(nodes[0], nodes[2]);
+        graph.precede(nodes[1], nodes[3]);
+        graph.precede(nodes[2], nodes[3]);
+
+        WHEN("it is run many times") {
+
+            bool ordered = true;
+            for (int run = 0; run < 100; ++run) {
+                graph.run(tp);
+                ordered = ordered && stamps[0] < stamps[1] &&
+                    stamps[0] < stamps[2] && stamps[1] < stamps[3] &&
+                    stamps[2] < stamps[3];
+            }
+
+            THEN("every run respects the dependencies") {
+
+                REQUIRE(ordered);
+                REQUIRE(clock == 400);
+                REQUIRE(graph.timing().nodes.size() == 4);
+            }
+        }
+
+        WHEN("an edge refers to a node that does not exist") {
+
+            THEN("precede throws") {
+
+                REQUIRE_THROWS_AS(graph.precede(nodes[0], 4),
+                        const std::out_of_range &);
+            }
+        }
+
+        WHEN("an edge closes a cycle") {
+
+            graph.precede(nodes[3], nodes[0]);
+
+            THEN("run throws") {
+
+                REQUIRE_THROWS_AS(graph.run(tp),
+                        const std::invalid_argument &);
+            }
+        }
+    }
+
+    GIVEN("a task pool with a single worker and a long chain") {
+
+        gungnir::TaskPool tp{1};
+        std::atomic<int> x{0};
+        gungnir::TaskGraph graph;
+        auto last = graph.add([&x] { ++x; });
+        for (int i = 0; i < 1000; ++i) {
+            const auto next = graph.add([&x] { ++x; });
+            graph.precede(last, next);
+            last = next;
+        }
+
+        WHEN("it is run") {
+
+            graph.run(tp);
+
+            THEN("every node runs without tying up the worker") {
+
+                REQUIRE(x == 1001);
+            }
+        }
+    }
+
+    GIVEN("a wide graph") {
+
+        gungnir::TaskPool tp{4};
+        std::atomic<int> x{0};
+        int sum = 0;
+        gungnir::TaskGraph graph;
+        const auto source = graph.add([] {});
+        const auto sink = graph.add([&x, &sum] { sum = x; });
+        for (int i = 0; i < 1000; ++i) {
+            const auto node = graph.add([&x] { ++x; });
+            graph.precede(source, node);
+            graph.precede(node, sink);
+        }
+
+        WHEN("it is run") {
+
+            graph.run(tp);
+
+            THEN("the sink runs after every other node") {
+
+                REQUIRE(sum == 1000);
+            }
+        }
+    }
+
+    GIVEN("a graph whose node throws on the first run") {
+
+        gungnir::TaskPool tp{2};
+        std::atomic<int> numRuns{0};
+        std::atomic<int> x{0};
+        gungnir::TaskGraph graph;
+        const auto a = graph.add([&numRuns] {
+            if (++numRuns == 1) {
+                throw std::runtime_error{"node"};
+            }
+        });
+        const auto b = graph.add([&x] { ++x; });
+        graph.precede(a, b);
+
+        WHEN("it is run twice") {
+
+            REQUIRE_THROWS_AS(graph.run(tp), const std::runtime_error &);
+            const auto skipped = x.load();
+            graph.run(tp);
+
+            THEN("the successors are skipped only in the failed run") {
+
+                REQUIRE(skipped == 0);
+                REQUIRE(x == 1);
+            }
+        }
+    }
+
+    GIVEN("a graph with a slow node") {
+
+        gungnir::TaskPool tp{2};
+        gungnir::TaskGraph graph;
+        const auto fast = graph.add([] {});
+        const auto slow = graph.add([] {
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        });
+
+        WHEN("it is run") {
+
+            graph.run(tp);
+
+            THEN("the timing of the run shows it") {
+
+                const auto &timing = graph.timing();
+                REQUIRE(timing.nodes[slow] >= std::chrono::milliseconds{10});
+                REQUIRE(timing.nodes[fast] < timing.nodes[slow]);
+                REQUIRE(timing.total >= timing.nodes[slow]);
+            }
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+
+SCENARIO("every wait strategy runs tasks and lets workers retire",
+        "[wait_strategy]") {
+
+    const std::pair<gungnir::WaitStrategy, std::string> strategies[] = {
+        {gungnir::WaitStrategy::Block, "Block"},
+        {gungnir::WaitStrategy::SpinThenPark, "SpinThenPark"},
+        {gungnir::WaitStrategy::Yield, "Yield"},
+        {gungnir::WaitStrategy::BusyPoll, "BusyPoll"},
+        {gungnir::WaitStrategy::Adaptive, "Adaptive"},
+    };
+
+    for (const auto &strategy: strategies) {
+
+        GIVEN("an elastic task pool using WaitStrategy::" + strategy.second) {
+
+            gungnir::TaskPoolOptions options;
+            options.minThreads = 0;
+            options.maxThreads = 2;
+            options.idleTimeout = std::chrono::milliseconds{10};
+            options.waitStrategy = strategy.first;
+            options.spinCount = 100;
+
+            std::atomic<int> x{0};
+            std::vector<gungnir::Task<void>> tasks;
+            for (int i = 0; i < 1000; ++i) {
+                tasks.emplace_back([&x] { ++x; });
+            }
+
+            WHEN("tasks are dispatched in bursts") {
+
+                gungnir::TaskPool tp{options};
+                for (int i = 0; i < 5; ++i) {
+                    tp.dispatchSync(tasks.cbegin(), tasks.cend());
+                    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+                }
+
+                THEN("they are all executed, and idle workers retire") {
+
+                    REQUIRE(x == 5000);
+
+                    const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::seconds{5};
+                    while (tp.numThreads() > 0 &&
+                            std::chrono::steady_clock::now() < deadline) {
+                        std::this_thread::sleep_for(
+                                std::chrono::milliseconds{1});
+                    }
+                    REQUIRE(tp.numThreads() == 0);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#include <atomic>
+#include <vector>
+
+#include "gungnir/gungnir.hpp"
+
+#include "catch.hpp"
+
+SCENARIO("a task pool can be warmed up before its first tasks",
+        "[warmup]") {
+
+    GIVEN("an elastic task pool with pre-allocated queues, pre-faulted "
+            "stacks and a warmup") {
+
+        gungnir::TaskPoolOptions options;
+        options.minThreads = 2;
+        options.maxThreads = 8;
+        options.initialQueueCapacity = 10000;
+        options.stackPrefault = 256 * 1024;
+        options.warmup = true;
+        gungnir::TaskPool tp{options};
+
+        THEN("the warmup leaves the pool at its initial size") {
+
+            REQUIRE(tp.numThreads() == 2);
+            REQUIRE(tp.stats().numQueued == 0);
+        }
+
+        WHEN("tasks are dispatched") {
+
+            std::atomic<int> x{0};
+            std::vector<gungnir::Task<void>> tasks(1000, [&x] { ++x; });
+            tp.dispatchSync(tasks.cbegin(), tasks.cend());
+
+            THEN("they are executed") {
+
+                REQUIRE(x == 1000);
+            }
+        }
+    }
+
+    GIVEN("a bounded task pool with a warmup") {
+
+        gungnir::TaskPoolOptions options;
+        options.minThreads = options.maxThreads = 2;
+        options.capacity = 4;
+        options.rejectionPolicy = gungnir::RejectionPolicy::Throw;
+        options.warmup = true;
+        gungnir::TaskPool tp{options};
+
+        WHEN("as many tasks are queued as fit") {
+
+            std::atomic<int> x{0};
+            std::vector<gungnir::Task<void>> tasks(4, [&x] { ++x; });
+            tp.dispatchSync(tasks.cbegin(), tasks.cend());
+
+            THEN("the warmup has not used up any room") {
+
+                REQUIRE(x == 4);
+            }
+        }
+    }
+}
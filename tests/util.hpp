@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// Polls `pred` until it holds, for up to 5 seconds; returns whether it did.
+template <typename P>
+bool eventually(const P &pred)
+{
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds{5};
+    while (!pred()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    return true;
+}
+
+// A steady clock that only moves when a test advances it, for TTLs and
+// expiry that must not race against how fast the test runs.
+struct ManualClock {
+    using duration = std::chrono::nanoseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<ManualClock>;
+
+    static constexpr bool is_steady = true;
+
+    static time_point now()
+    {
+        return time_point{duration{ticks().load()}};
+    }
+
+    static void advance(duration d)
+    {
+        ticks() += d.count();
+    }
+
+private:
+    static std::atomic<rep> & ticks()
+    {
+        static std::atomic<rep> ticks{0};
+        return ticks;
+    }
+};
+
+// Starts a thread that calls `f` once `pool` has begun to shut down, for
+// tests that keep a worker blocked until the shutdown cannot miss it.
+template <typename Pool, typename F>
+std::thread onceShutDown(Pool &pool, F f)
+{
+    return std::thread{[&pool, f] {
+        while (!pool.isShutDown()) {
+            std::this_thread::yield();
+        }
+        f();
+    }};
+}